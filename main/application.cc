@@ -72,6 +72,9 @@ void Application::Initialize() {
     auto codec = board.GetAudioCodec();
     audio_service_.Initialize(codec);
     audio_service_.Start();
+    // The sounds on the way into listening are decoded ahead, so they are not delayed by the decoder
+    audio_service_.CacheSound(Lang::Sounds::OGG_POPUP);
+    audio_service_.CacheSound(Lang::Sounds::OGG_SUCCESS);
 
     AudioServiceCallbacks callbacks;
     callbacks.on_send_queue_available = [this]() {
@@ -83,6 +86,9 @@ void Application::Initialize() {
     callbacks.on_vad_change = [this](bool speaking) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+    callbacks.on_barge_in = [this]() {
+        xEventGroupSetBits(event_group_, MAIN_EVENT_BARGE_IN);
+    };
     audio_service_.SetCallbacks(callbacks);
 
     // =========== 建议添加的位置 ===========
@@ -183,7 +189,8 @@ void Application::Run() {
         MAIN_EVENT_START_LISTENING |
         MAIN_EVENT_STOP_LISTENING |
         MAIN_EVENT_ACTIVATION_DONE |
-        MAIN_EVENT_STATE_CHANGED;
+        MAIN_EVENT_STATE_CHANGED |
+        MAIN_EVENT_BARGE_IN;
 
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
@@ -223,7 +230,14 @@ void Application::Run() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
+                if (!protocol_) {
+                    continue;
+                }
+                int64_t send_start_us = esp_timer_get_time();
+                bool sent = protocol_->SendAudio(std::move(packet));
+                AudioLatencyStats::GetInstance().RecordSince(kAudioLatencySend, send_start_us);
+                if (!sent) {
+                    audio_service_.ReportSendFailure();
                     break;
                 }
             }
@@ -233,6 +247,10 @@ void Application::Run() {
             HandleWakeWordDetectedEvent();
         }
 
+        if (bits & MAIN_EVENT_BARGE_IN) {
+            HandleBargeInEvent();
+        }
+
         if (bits & MAIN_EVENT_VAD_CHANGE) {
             if (GetDeviceState() == kDeviceStateListening) {
                 auto led = Board::GetInstance().GetLed();
@@ -257,6 +275,7 @@ void Application::Run() {
             // Print debug info every 10 seconds
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
+                AudioLatencyStats::GetInstance().Print();
             }
         }
     }
@@ -489,6 +508,11 @@ void Application::InitializeProtocol() {
         protocol_ = std::make_unique<MqttProtocol>();
     }
 
+    {
+        Settings settings("audio", false);
+        protocol_->SetPreferredFrameDuration(settings.GetInt("frame_duration", CONFIG_OPUS_UPLINK_FRAME_DURATION_MS));
+    }
+
     protocol_->OnConnected([this]() {
         DismissAlert();
     });
@@ -498,14 +522,16 @@ void Application::InitializeProtocol() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
     
-    protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+    protocol_->OnIncomingAudio([this](AudioStreamPacketPtr packet) {
         if (GetDeviceState() == kDeviceStateSpeaking) {
+            packet->stage_time_us = esp_timer_get_time();
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
     
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
+        audio_service_.SetEncodeFrameDuration(protocol_->uplink_frame_duration());
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -696,6 +722,8 @@ void Application::HandleToggleChatEvent() {
     }
 
     if (state == kDeviceStateIdle) {
+        // The user is about to speak, let the microphone settle while the channel opens
+        audio_service_.PrepareInput();
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
             if (!protocol_->OpenAudioChannel()) {
@@ -729,6 +757,8 @@ void Application::HandleStartListeningEvent() {
     }
     
     if (state == kDeviceStateIdle) {
+        // The user is about to speak, let the microphone settle while the channel opens
+        audio_service_.PrepareInput();
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
             if (!protocol_->OpenAudioChannel()) {
@@ -800,6 +830,17 @@ void Application::HandleWakeWordDetectedEvent() {
     }
 }
 
+void Application::HandleBargeInEvent() {
+    if (!protocol_ || GetDeviceState() != kDeviceStateSpeaking) {
+        return;
+    }
+
+    // The audio service has stopped the playback already, tell the server and listen to the user
+    ESP_LOGI(TAG, "Barge-in detected");
+    AbortSpeaking(kAbortReasonNone);
+    SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+}
+
 void Application::HandleStateChangedEvent() {
     DeviceState new_state = state_machine_.GetState();
     clock_ticks_ = 0;
@@ -808,6 +849,15 @@ void Application::HandleStateChangedEvent() {
     auto display = board.GetDisplay();
     auto led = board.GetLed();
     led->OnStateChanged();
+    audio_service_.SetEncoderPriorityBoost(new_state == kDeviceStateListening);
+    // The processor keeps running through Speaking in realtime mode, so does the suppression
+    audio_service_.EnableSilenceSuppression(listening_mode_ == kListeningModeRealtime &&
+        (new_state == kDeviceStateListening || new_state == kDeviceStateSpeaking));
+#if CONFIG_USE_BARGE_IN_DETECTION
+    // Push to talk interrupts with the button
+    audio_service_.EnableBargeInDetection(new_state == kDeviceStateSpeaking &&
+        listening_mode_ != kListeningModeManualStop);
+#endif
     
     switch (new_state) {
         case kDeviceStateUnknown:
@@ -818,6 +868,7 @@ void Application::HandleStateChangedEvent() {
             audio_service_.EnableWakeWordDetection(true);
             break;
         case kDeviceStateConnecting:
+            audio_service_.PrepareInput();
             display->SetStatus(Lang::Strings::CONNECTING);
             display->SetEmotion("neutral");
             display->SetChatMessage("system", "");
@@ -1045,6 +1096,20 @@ void Application::SetAecMode(AecMode mode) {
     });
 }
 
+bool Application::SetUplinkFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        return false;
+    }
+    Settings settings("audio", true);
+    settings.SetInt("frame_duration", frame_duration_ms);
+    Schedule([this, frame_duration_ms]() {
+        if (protocol_) {
+            protocol_->SetPreferredFrameDuration(frame_duration_ms);
+        }
+    });
+    return true;
+}
+
 void Application::PlaySound(const std::string_view& sound) {
     audio_service_.PlaySound(sound);
 }
@@ -31,6 +31,7 @@
 #define MAIN_EVENT_START_LISTENING      (1 << 10)
 #define MAIN_EVENT_STOP_LISTENING       (1 << 11)
 #define MAIN_EVENT_STATE_CHANGED        (1 << 12)
+#define MAIN_EVENT_BARGE_IN             (1 << 13)
 
 
 enum AecMode {
@@ -110,6 +111,8 @@ public:
     void SendMcpMessage(const std::string& payload);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
+    // Saves the uplink frame duration to offer in the hello, used from the next audio channel
+    bool SetUplinkFrameDuration(int frame_duration_ms);
     void PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
     
@@ -153,6 +156,7 @@ private:
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
     void HandleWakeWordDetectedEvent();
+    void HandleBargeInEvent();
 
     // Activation task (runs in background)
     void ActivationTask();
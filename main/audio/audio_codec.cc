@@ -1,23 +1,76 @@
 #include "audio_codec.h"
 #include "board.h"
 #include "settings.h"
+#include "audio_dsp.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <cstring>
+#include <algorithm>
 #include <driver/i2s_common.h>
 
 #define TAG "AudioCodec"
 
 AudioCodec::AudioCodec() {
+    output_gain_q16_ = AudioVolumeToGainQ16(output_volume_);
 }
 
 AudioCodec::~AudioCodec() {
 }
 
 void AudioCodec::OutputData(std::vector<int16_t>& data) {
+    if (output_enabled_) {
+        portENTER_CRITICAL(&output_position_lock_);
+        if (output_played_frames_ == output_written_frames_) {
+            output_underrun_ = true;
+        }
+        output_written_frames_ += data.size();
+        portEXIT_CRITICAL(&output_position_lock_);
+    }
     Write(data.data(), data.size());
 }
 
+bool IRAM_ATTR AudioCodec::OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = static_cast<AudioCodec*>(user_ctx);
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&codec->output_position_lock_);
+    if (codec->output_underrun_) {
+        codec->output_underrun_ = false;
+    } else {
+        // A descriptor past the written frames was cleared silence
+        codec->output_played_frames_ = std::min<uint64_t>(codec->output_played_frames_ + AUDIO_CODEC_DMA_FRAME_NUM,
+            codec->output_written_frames_);
+    }
+    codec->output_played_time_us_ = now;
+    portEXIT_CRITICAL_ISR(&codec->output_position_lock_);
+    return false;
+}
+
+uint64_t AudioCodec::output_written_frames() {
+    portENTER_CRITICAL(&output_position_lock_);
+    uint64_t written = output_written_frames_;
+    portEXIT_CRITICAL(&output_position_lock_);
+    return written;
+}
+
+uint64_t AudioCodec::GetOutputPosition(int64_t time_us) {
+    portENTER_CRITICAL(&output_position_lock_);
+    uint64_t written = output_written_frames_;
+    uint64_t played = output_played_frames_;
+    int64_t played_time_us = output_played_time_us_;
+    bool underrun = output_underrun_;
+    portEXIT_CRITICAL(&output_position_lock_);
+    if (played_time_us == 0 || underrun) {
+        return played;
+    }
+
+    // The DAC runs at the sample rate from the end of the last descriptor, which is at most one ahead
+    int64_t offset = (time_us - played_time_us) * output_sample_rate_ / 1000000;
+    offset = std::min<int64_t>(offset, AUDIO_CODEC_DMA_FRAME_NUM);
+    int64_t position = std::max<int64_t>(0, (int64_t)played + offset);
+    return std::min<uint64_t>(position, written);
+}
+
 bool AudioCodec::InputData(std::vector<int16_t>& data) {
     int samples = Read(data.data(), data.size());
     if (samples > 0) {
@@ -33,8 +86,13 @@ void AudioCodec::Start() {
         ESP_LOGW(TAG, "Output volume value (%d) is too small, setting to default (10)", output_volume_);
         output_volume_ = 10;
     }
+    output_gain_q16_ = AudioVolumeToGainQ16(output_volume_);
 
     if (tx_handle_ != nullptr) {
+        // Callbacks can only be registered before the channel is enabled
+        i2s_event_callbacks_t callbacks = {};
+        callbacks.on_sent = OnOutputSent;
+        ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_handle_, &callbacks, this));
         ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
     }
 
@@ -49,6 +107,7 @@ void AudioCodec::Start() {
 
 void AudioCodec::SetOutputVolume(int volume) {
     output_volume_ = volume;
+    output_gain_q16_ = AudioVolumeToGainQ16(output_volume_);
     ESP_LOGI(TAG, "Set output volume to %d", output_volume_);
     
     Settings settings("audio", true);
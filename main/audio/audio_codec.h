@@ -4,6 +4,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <driver/i2s_std.h>
+#include <esp_attr.h>
 
 #include <vector>
 #include <string>
@@ -28,6 +29,11 @@ public:
     virtual bool InputData(std::vector<int16_t>& data);
     virtual void Start();
 
+    // Output frames handed to OutputData() since the codec started
+    uint64_t output_written_frames();
+    // Output frame the DAC plays at time_us, interpolated from the last DMA descriptor sent
+    virtual uint64_t GetOutputPosition(int64_t time_us);
+
     inline bool duplex() const { return duplex_; }
     inline bool input_reference() const { return input_reference_; }
     inline int input_sample_rate() const { return input_sample_rate_; }
@@ -52,8 +58,20 @@ protected:
     int input_channels_ = 1;
     int output_channels_ = 1;
     int output_volume_ = 70;
+    // Software output gain for the codecs without a hardware volume, follows output_volume_ (Q16)
+    int32_t output_gain_q16_ = 0;
     float input_gain_ = 0.0;
 
+    // Playback position, counted by the DMA sent interrupt and guarded by output_position_lock_
+    portMUX_TYPE output_position_lock_ = portMUX_INITIALIZER_UNLOCKED;
+    uint64_t output_written_frames_ = 0;
+    uint64_t output_played_frames_ = 0;
+    int64_t output_played_time_us_ = 0;
+    // The descriptor in flight when a write ends an underrun holds silence, not the new frames
+    bool output_underrun_ = false;
+
+    static bool IRAM_ATTR OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+
     virtual int Read(int16_t* dest, int samples) = 0;
     virtual int Write(const int16_t* data, int samples) = 0;
 };
@@ -0,0 +1,61 @@
+#include "audio_decoder_cache.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioDecoderCache"
+
+void AudioDecoderCache::Configure(int output_sample_rate) {
+    output_sample_rate_ = output_sample_rate;
+    for (auto& entry : entries_) {
+        entry.decoder.reset();
+        entry.last_used = 0;
+    }
+    use_count_ = 0;
+}
+
+AudioDecoderCache::Entry& AudioDecoderCache::Get(int sample_rate, int frame_duration) {
+    // Pick the entry of the key, else an empty one, else the least recently used
+    Entry* victim = nullptr;
+    for (auto& entry : entries_) {
+        if (entry.decoder && entry.decoder->sample_rate() == sample_rate && entry.decoder->duration_ms() == frame_duration) {
+            if (entry.last_used != use_count_) {
+                stats_.hits++;
+            }
+            entry.last_used = ++use_count_;
+            return entry;
+        }
+        if (victim == nullptr || (victim->decoder && (!entry.decoder || entry.last_used < victim->last_used))) {
+            victim = &entry;
+        }
+    }
+
+    if (victim->decoder) {
+        ESP_LOGI(TAG, "Evicting the %d Hz / %d ms decoder", victim->decoder->sample_rate(), victim->decoder->duration_ms());
+        victim->decoder.reset();
+        stats_.evictions++;
+    }
+    victim->decoder = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    victim->resampler.Configure(sample_rate, output_sample_rate_);
+    victim->last_used = ++use_count_;
+    stats_.allocations++;
+    ESP_LOGI(TAG, "Created a %d Hz / %d ms decoder", sample_rate, frame_duration);
+    return *victim;
+}
+
+void AudioDecoderCache::ResetState() {
+    for (auto& entry : entries_) {
+        if (entry.decoder) {
+            entry.decoder->ResetState();
+            entry.resampler.Reset();
+        }
+    }
+}
+
+AudioDecoderCacheStats AudioDecoderCache::GetStats() const {
+    AudioDecoderCacheStats stats = stats_;
+    stats.entries = 0;
+    for (const auto& entry : entries_) {
+        stats.entries += entry.decoder ? 1 : 0;
+    }
+    return stats;
+}
@@ -0,0 +1,60 @@
+#ifndef AUDIO_DECODER_CACHE_H
+#define AUDIO_DECODER_CACHE_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include <opus_decoder.h>
+
+#include "audio_resampler.h"
+
+// Decoders kept warm: the server TTS, the audio testing playback, and one spare for a frame duration change
+#define AUDIO_DECODER_CACHE_SIZE 3
+
+struct AudioDecoderCacheStats {
+    uint32_t hits = 0;              // Switches to a decoder that was still cached
+    uint32_t allocations = 0;       // Decoders created
+    uint32_t evictions = 0;         // Decoders destroyed to make room
+    uint32_t entries = 0;
+};
+
+/*
+ * Opus decoders with their resampler to the speaker rate, keyed by (sample rate, frame duration).
+ *
+ * The audio testing playback (16 kHz) and the server TTS (often 24 kHz) take turns on the
+ * downlink; instead of re-creating the decoder on every switch, each stream keeps its own
+ * decoder and resampler, with their state, for when it comes back. The local sounds have a
+ * cache of their own. The least recently used entry is destroyed when a
+ * new key does not fit.
+ *
+ * Not thread safe, owned by the opus decoder task. Entries stay at the same address until
+ * they are evicted or the cache is configured again.
+ */
+class AudioDecoderCache {
+public:
+    struct Entry {
+        std::unique_ptr<OpusDecoderWrapper> decoder;
+        // Decoder rate to the output rate, only configured when they differ
+        AudioResampler resampler;
+        uint32_t last_used = 0;
+
+        bool resampling() const { return resampler.input_sample_rate() != resampler.output_sample_rate(); }
+    };
+
+    // Drops every decoder, the new ones resample to output_sample_rate
+    void Configure(int output_sample_rate);
+    // The decoder for the stream, created if needed
+    Entry& Get(int sample_rate, int frame_duration);
+    // A new stream starts, no decoder carries state into it
+    void ResetState();
+    AudioDecoderCacheStats GetStats() const;
+
+private:
+    int output_sample_rate_ = 0;
+    Entry entries_[AUDIO_DECODER_CACHE_SIZE];
+    uint32_t use_count_ = 0;
+    AudioDecoderCacheStats stats_;
+};
+
+#endif // AUDIO_DECODER_CACHE_H
@@ -0,0 +1,217 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * Small PCM kernels shared by the audio pipeline.
+ *
+ * The loops move two 16-bit samples per 32-bit little-endian load / store (the buffers
+ * come from std::vector, so they are at least 4-byte aligned), which halves the memory traffic
+ * on the Xtensa / RISC-V cores and leaves simple loops for the compiler to unroll.
+ */
+
+static inline uint32_t AudioLoad32(const int16_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void AudioStore32(int16_t* p, uint32_t v) {
+    std::memcpy(p, &v, sizeof(v));
+}
+
+// Split interleaved stereo into two planar channels
+static inline void AudioDeinterleave(const int16_t* src, size_t frames, int16_t* left, int16_t* right) {
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t w0 = AudioLoad32(src + i * 2);      // L0 | R0 << 16
+        uint32_t w1 = AudioLoad32(src + i * 2 + 2);  // L1 | R1 << 16
+        AudioStore32(left + i, (w0 & 0xFFFF) | (w1 << 16));
+        AudioStore32(right + i, (w0 >> 16) | (w1 & 0xFFFF0000));
+    }
+    for (; i < frames; ++i) {
+        left[i] = src[i * 2];
+        right[i] = src[i * 2 + 1];
+    }
+}
+
+// Merge two planar channels into interleaved stereo
+static inline void AudioInterleave(const int16_t* left, const int16_t* right, size_t frames, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t l = AudioLoad32(left + i);   // L0 | L1 << 16
+        uint32_t r = AudioLoad32(right + i);  // R0 | R1 << 16
+        AudioStore32(dst + i * 2, (l & 0xFFFF) | (r << 16));
+        AudioStore32(dst + i * 2 + 2, (l >> 16) | (r & 0xFFFF0000));
+    }
+    for (; i < frames; ++i) {
+        dst[i * 2] = left[i];
+        dst[i * 2 + 1] = right[i];
+    }
+}
+
+// Copy the first channel of interleaved stereo, dst may be the same buffer as src
+static inline void AudioTakeLeftChannel(const int16_t* src, size_t frames, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t w0 = AudioLoad32(src + i * 2);
+        uint32_t w1 = AudioLoad32(src + i * 2 + 2);
+        AudioStore32(dst + i, (w0 & 0xFFFF) | (w1 << 16));
+    }
+    for (; i < frames; ++i) {
+        dst[i] = src[i * 2];
+    }
+}
+
+// Q15 gains, 32768 is unity
+#define AUDIO_GAIN_UNITY_Q15 32768
+
+static inline int16_t AudioSaturate16(int32_t v) {
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+// Scale in place, the gain moves linearly from gain_from to gain_to across the buffer (Q15)
+static inline void AudioApplyGainRamp(int16_t* pcm, size_t samples, int32_t gain_from, int32_t gain_to) {
+    if (samples == 0) {
+        return;
+    }
+    // Q15 gain in the upper bits, so the per-sample step keeps its precision over a long buffer
+    int64_t gain = (int64_t)gain_from << 16;
+    int64_t step = (((int64_t)gain_to - gain_from) << 16) / (int64_t)samples;
+    for (size_t i = 0; i < samples; ++i) {
+        pcm[i] = AudioSaturate16((int32_t)((pcm[i] * (gain >> 16)) >> 15));
+        gain += step;
+    }
+}
+
+// dst += src * gain (Q15, up to unity), saturating
+static inline void AudioMixInto(int16_t* dst, const int16_t* src, size_t samples, int32_t gain) {
+    if (gain == AUDIO_GAIN_UNITY_Q15) {
+        for (size_t i = 0; i < samples; ++i) {
+            dst[i] = AudioSaturate16((int32_t)dst[i] + src[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < samples; ++i) {
+        dst[i] = AudioSaturate16((int32_t)dst[i] + ((src[i] * gain) >> 15));
+    }
+}
+
+// Q16 gains, 65536 is unity
+#define AUDIO_GAIN_UNITY_Q16 65536
+
+// Volume 0-100 to a Q16 gain, squared so the steps sound even
+static inline int32_t AudioVolumeToGainQ16(int volume) {
+    if (volume <= 0) {
+        return 0;
+    }
+    if (volume >= 100) {
+        return AUDIO_GAIN_UNITY_Q16;
+    }
+    return volume * volume * AUDIO_GAIN_UNITY_Q16 / 10000;
+}
+
+/*
+ * The conversion loops below run on every I2S read / write. They handle four samples per
+ * iteration with no data-dependent branches, the clamps compile to the Xtensa CLAMPS /
+ * RISC-V min / max instructions.
+ */
+
+// 16-bit PCM to the left-aligned 32-bit I2S format, scaled by a Q16 gain up to unity (it cannot overflow)
+static inline void AudioScaleToInt32(const int16_t* src, size_t samples, int32_t gain_q16, int32_t* dst) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        dst[i] = src[i] * gain_q16;
+        dst[i + 1] = src[i + 1] * gain_q16;
+        dst[i + 2] = src[i + 2] * gain_q16;
+        dst[i + 3] = src[i + 3] * gain_q16;
+    }
+    for (; i < samples; ++i) {
+        dst[i] = src[i] * gain_q16;
+    }
+}
+
+static inline int16_t AudioClampSymmetric16(int32_t v) {
+    return v > INT16_MAX ? INT16_MAX : (v < -INT16_MAX ? -INT16_MAX : (int16_t)v);
+}
+
+// 32-bit I2S samples to 16-bit PCM, shifted right and saturated to +-INT16_MAX
+static inline void AudioInt32ToInt16(const int32_t* src, size_t samples, int shift, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        dst[i] = AudioClampSymmetric16(src[i] >> shift);
+        dst[i + 1] = AudioClampSymmetric16(src[i + 1] >> shift);
+        dst[i + 2] = AudioClampSymmetric16(src[i + 2] >> shift);
+        dst[i + 3] = AudioClampSymmetric16(src[i + 3] >> shift);
+    }
+    for (; i < samples; ++i) {
+        dst[i] = AudioClampSymmetric16(src[i] >> shift);
+    }
+}
+
+// Multiply in place by an integer gain, saturated to +-INT16_MAX
+static inline void AudioApplyIntGain(int16_t* pcm, size_t samples, int gain) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        pcm[i] = AudioClampSymmetric16(pcm[i] * gain);
+        pcm[i + 1] = AudioClampSymmetric16(pcm[i + 1] * gain);
+        pcm[i + 2] = AudioClampSymmetric16(pcm[i + 2] * gain);
+        pcm[i + 3] = AudioClampSymmetric16(pcm[i + 3] * gain);
+    }
+    for (; i < samples; ++i) {
+        pcm[i] = AudioClampSymmetric16(pcm[i] * gain);
+    }
+}
+
+// Q15 dot product of n samples and FIR taps, two accumulators so the multiplies can overlap.
+// The taps of a resampler phase sum to about unity, so the sum stays within int32.
+static inline int32_t AudioDotProduct16(const int16_t* x, const int16_t* h, size_t n) {
+    int32_t acc0 = 0;
+    int32_t acc1 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 += x[i] * h[i] + x[i + 2] * h[i + 2];
+        acc1 += x[i + 1] * h[i + 1] + x[i + 3] * h[i + 3];
+    }
+    for (; i < n; ++i) {
+        acc0 += x[i] * h[i];
+    }
+    return acc0 + acc1;
+}
+
+// Sum of squares and peak magnitude of the first channel in one pass, for level metering.
+// Mono reads two samples per 32-bit load into two accumulators, so the multiplies can overlap;
+// a square is at most 2^30, the 64-bit sums do not overflow.
+static inline void AudioMeasureLevel(const int16_t* pcm, size_t frames, int channels, uint64_t& sum_squares, int32_t& peak) {
+    uint64_t acc0 = 0;
+    uint64_t acc1 = 0;
+    int32_t max0 = 0;
+    int32_t max1 = 0;
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 2 <= frames; i += 2) {
+            uint32_t w = AudioLoad32(pcm + i);
+            int32_t a = (int16_t)(w & 0xFFFF);
+            int32_t b = (int16_t)(w >> 16);
+            acc0 += (uint32_t)(a * a);
+            acc1 += (uint32_t)(b * b);
+            a = a < 0 ? -a : a;
+            b = b < 0 ? -b : b;
+            max0 = a > max0 ? a : max0;
+            max1 = b > max1 ? b : max1;
+        }
+    }
+    for (; i < frames; ++i) {
+        int32_t a = pcm[i * channels];
+        acc0 += (uint32_t)(a * a);
+        a = a < 0 ? -a : a;
+        max0 = a > max0 ? a : max0;
+    }
+    sum_squares = acc0 + acc1;
+    peak = max0 > max1 ? max0 : max1;
+}
+
+#endif // AUDIO_DSP_H
@@ -0,0 +1,83 @@
+#include "audio_frame_assembler.h"
+#include "audio_latency.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "AudioFrameAssembler"
+
+AudioFrameAssembler::AudioFrameAssembler(size_t capacity) : ring_(capacity) {
+}
+
+void AudioFrameAssembler::Push(const int16_t* data, size_t samples, int64_t time_us) {
+    const size_t capacity = ring_.size();
+    if (samples > capacity) {
+        data += samples - capacity;
+        write_position_ += samples - capacity;
+        samples = capacity;
+    }
+    if (available() + samples > capacity) {
+        uint64_t read_position = write_position_ + samples - capacity;
+        stats_.dropped_samples += read_position - read_position_;
+        if (stats_.overruns++ % 100 == 0) {
+            ESP_LOGW(TAG, "Frame assembler overrun, dropped %lu samples (%lu times)",
+                (unsigned long)stats_.dropped_samples, (unsigned long)stats_.overruns);
+        }
+        read_position_ = read_position;
+    }
+
+    size_t offset = write_position_ % capacity;
+    size_t first = std::min(samples, capacity - offset);
+    memcpy(ring_.data() + offset, data, first * sizeof(int16_t));
+    memcpy(ring_.data(), data + first, (samples - first) * sizeof(int16_t));
+
+    // A full stamp list forgets its oldest chunk, whose samples then take the next stamp
+    if (chunk_count_ == AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS) {
+        chunk_head_ = (chunk_head_ + 1) % AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS;
+        chunk_count_--;
+    }
+    chunks_[(chunk_head_ + chunk_count_) % AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS] = {write_position_, time_us};
+    chunk_count_++;
+    write_position_ += samples;
+}
+
+int64_t AudioFrameAssembler::ChunkTime(uint64_t position) {
+    // Drop the chunks that end before the position, the head is then the chunk holding it
+    while (chunk_count_ > 1) {
+        const Chunk& next = chunks_[(chunk_head_ + 1) % AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS];
+        if (next.position > position) {
+            break;
+        }
+        chunk_head_ = (chunk_head_ + 1) % AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS;
+        chunk_count_--;
+    }
+    return chunk_count_ > 0 ? chunks_[chunk_head_].time_us : 0;
+}
+
+bool AudioFrameAssembler::Pop(std::vector<int16_t>& frame) {
+    const size_t samples = frame_samples_;
+    if (samples == 0 || available() < samples) {
+        return false;
+    }
+
+    const size_t capacity = ring_.size();
+    size_t offset = read_position_ % capacity;
+    size_t first = std::min(samples, capacity - offset);
+    frame.resize(samples);
+    memcpy(frame.data(), ring_.data() + offset, first * sizeof(int16_t));
+    memcpy(frame.data() + first, ring_.data(), (samples - first) * sizeof(int16_t));
+
+    AudioLatencyStats::GetInstance().RecordSince(kAudioLatencyAssembly, ChunkTime(read_position_));
+    read_position_ += samples;
+    stats_.frames++;
+    return true;
+}
+
+void AudioFrameAssembler::Reset() {
+    read_position_ = write_position_;
+    chunk_head_ = 0;
+    chunk_count_ = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef AUDIO_FRAME_ASSEMBLER_H
+#define AUDIO_FRAME_ASSEMBLER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Fetch stamps kept for the samples waiting in the ring, one per Push()
+#define AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS 16
+
+struct AudioFrameAssemblerStats {
+    uint32_t frames = 0;
+    uint32_t overruns = 0;      // Push() calls that overwrote samples not popped yet
+    uint32_t dropped_samples = 0;
+};
+
+/*
+ * Cuts a stream of PCM chunks into frames of another size.
+ *
+ * The chunks are copied into a fixed circular buffer and Pop() copies each full frame out
+ * of it, wrapping around the end, so nothing is shifted or allocated per frame. Each chunk
+ * keeps the time it was pushed, and Pop() records how long the first sample of the frame
+ * waited as the kAudioLatencyAssembly stage.
+ *
+ * Not thread safe, owned by the task that fetches the chunks.
+ */
+class AudioFrameAssembler {
+public:
+    explicit AudioFrameAssembler(size_t capacity);
+
+    // Applies to the next Pop(), the samples already pushed are kept
+    void SetFrameSamples(size_t frame_samples) { frame_samples_ = frame_samples; }
+    size_t frame_samples() const { return frame_samples_; }
+    size_t available() const { return (size_t)(write_position_ - read_position_); }
+
+    void Push(const int16_t* data, size_t samples, int64_t time_us);
+    // Fills frame with the oldest full frame, returns false when less than a frame is stored
+    bool Pop(std::vector<int16_t>& frame);
+    void Reset();
+    AudioFrameAssemblerStats GetStats() const { return stats_; }
+
+private:
+    struct Chunk {
+        uint64_t position;
+        int64_t time_us;
+    };
+
+    std::vector<int16_t> ring_;
+    size_t frame_samples_ = 0;
+    uint64_t write_position_ = 0;
+    uint64_t read_position_ = 0;
+    Chunk chunks_[AUDIO_FRAME_ASSEMBLER_MAX_CHUNKS];
+    size_t chunk_head_ = 0;
+    size_t chunk_count_ = 0;
+    AudioFrameAssemblerStats stats_;
+
+    int64_t ChunkTime(uint64_t position);
+};
+
+#endif // AUDIO_FRAME_ASSEMBLER_H
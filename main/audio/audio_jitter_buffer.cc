@@ -0,0 +1,212 @@
+#include "audio_jitter_buffer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstdlib>
+
+#define TAG "AudioJitterBuffer"
+
+static int GetFrameDuration(int frame_duration) {
+    return frame_duration > 0 ? frame_duration : 60;
+}
+
+static int GetFrameDuration(const AudioStreamPacket& packet) {
+    return GetFrameDuration(packet.frame_duration);
+}
+
+AudioJitterBuffer::AudioJitterBuffer() {
+    entries_.reserve(JITTER_BUFFER_CAPACITY);
+}
+
+void AudioJitterBuffer::OnPacketArrival(uint32_t sequence, int frame_duration) {
+    int64_t now = esp_timer_get_time();
+    frame_duration = GetFrameDuration(frame_duration);
+    int frames = 1;
+    if (sequence != 0 && last_arrival_sequence_ != 0) {
+        frames = static_cast<int32_t>(sequence - last_arrival_sequence_);
+    }
+    if (frames <= 0) {
+        // Reordered or duplicated, keep the newest packet as the reference
+        return;
+    }
+
+    if (last_arrival_us_ != 0 && now - last_arrival_us_ < JITTER_BUFFER_ARRIVAL_RESET_MS * 1000 &&
+        frames <= JITTER_BUFFER_MAX_SEQUENCE_GAP) {
+        // Only late arrivals need buffering, early ones (the server sends ahead) wait in the queues anyway
+        int delay_ms = (now - last_arrival_us_) / 1000 - frames * frame_duration;
+        if (delay_ms < 0) {
+            delay_ms = 0;
+        }
+        // RFC 3550 style smoothing, the estimate is kept in 1/16 ms
+        jitter_q4_ += delay_ms - ((jitter_q4_ + 8) >> 4);
+        uint32_t jitter_ms = jitter_q4_ >> 4;
+        uint32_t target = 1 + (4 * jitter_ms + frame_duration - 1) / frame_duration;
+        jitter_ms_ = jitter_ms;
+        target_depth_ = std::min<uint32_t>(target, JITTER_BUFFER_MAX_TARGET_FRAMES);
+    }
+    last_arrival_us_ = now;
+    last_arrival_sequence_ = sequence;
+}
+
+void AudioJitterBuffer::Insert(AudioStreamPacketPtr packet) {
+    uint64_t key;
+    bool same_stream;
+    const uint32_t expected_stream = has_expected_ ? expected_key_ >> 32 : 0;
+    if (packet->sequence == 0) {
+        // Keys of their own, behind the sequenced packets already queued
+        same_stream = has_local_key_ && (local_key_ >> 32) == last_stream_;
+        if (!same_stream) {
+            local_key_ = MakeKey(++last_stream_, 0);
+            has_local_key_ = true;
+        }
+        key = ++local_key_;
+    } else {
+        int32_t distance = static_cast<int32_t>(packet->sequence - static_cast<uint32_t>(last_key_));
+        same_stream = has_last_key_ && std::abs(distance) <= JITTER_BUFFER_MAX_SEQUENCE_GAP;
+        // A local sound that started playing in between leaves the rest of the stream for after it
+        if (same_stream && stream_ < expected_stream && distance > 0) {
+            same_stream = false;
+        }
+        if (!same_stream) {
+            stream_ = ++last_stream_;
+        }
+        key = MakeKey(stream_, packet->sequence);
+    }
+
+    if (has_expected_ && key < expected_key_) {
+        late_packets_++;
+        return;
+    }
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), key, [](uint64_t key, const Entry& entry) {
+        return key < entry.key;
+    });
+    if (it != entries_.begin() && std::prev(it)->key == key) {
+        // Duplicated by the network
+        late_packets_++;
+        return;
+    }
+
+    if (!playing_ && entries_.empty()) {
+        buffering_since_us_ = esp_timer_get_time();
+    }
+    if (dry_since_us_ != 0) {
+        // The stream went on after running dry, or this is the next one
+        if (same_stream && buffering_since_us_ - dry_since_us_ < JITTER_BUFFER_ARRIVAL_RESET_MS * 1000) {
+            underruns_++;
+        }
+        dry_since_us_ = 0;
+    }
+    const bool sequenced = packet->sequence != 0;
+    entries_.insert(it, Entry{key, std::move(packet)});
+    if (sequenced && (!has_last_key_ || key > last_key_)) {
+        last_key_ = key;
+        has_last_key_ = true;
+    }
+    depth_ = entries_.size();
+}
+
+bool AudioJitterBuffer::IsStartReady() const {
+    if (entries_.empty()) {
+        return false;
+    }
+    uint32_t target = target_depth_;
+    if (entries_.size() >= target) {
+        return true;
+    }
+    // Do not hold back the tail of a short stream
+    int frame_duration = GetFrameDuration(*entries_.front().packet);
+    return esp_timer_get_time() - buffering_since_us_ >= static_cast<int64_t>(target) * frame_duration * 1000;
+}
+
+bool AudioJitterBuffer::IsReady(bool deadline) const {
+    if (!playing_) {
+        return IsStartReady();
+    }
+    if (entries_.empty()) {
+        // Ran dry, PopFrame() records the underrun and buffers again
+        return deadline;
+    }
+    uint64_t key = entries_.front().key;
+    if (key == expected_key_ || (key >> 32) != (expected_key_ >> 32)) {
+        return true;
+    }
+    // The expected frame is missing, wait for it as long as the speaker has something to play
+    return deadline;
+}
+
+AudioStreamPacketPtr AudioJitterBuffer::PopFrame(bool deadline) {
+    if (!IsReady(deadline)) {
+        return nullptr;
+    }
+    if (entries_.empty()) {
+        // An underrun or the end of the stream, Insert() tells them apart
+        dry_since_us_ = esp_timer_get_time();
+        playing_ = false;
+        concealed_in_row_ = 0;
+        return nullptr;
+    }
+
+    Entry& front = entries_.front();
+    if (!playing_ || (front.key >> 32) != (expected_key_ >> 32)) {
+        // Start playing, or move on to the next stream
+        playing_ = true;
+        has_expected_ = true;
+        expected_key_ = front.key;
+    }
+
+    if (front.key != expected_key_) {
+        if (concealed_in_row_ < JITTER_BUFFER_MAX_CONCEALED_FRAMES) {
+            concealed_in_row_++;
+            concealed_frames_++;
+            expected_key_++;
+            // An empty payload makes the decoder conceal the lost frame
+            auto packet = AudioPacketPool::GetInstance().Acquire();
+            packet->sample_rate = last_sample_rate_;
+            packet->frame_duration = last_frame_duration_;
+            return packet;
+        }
+        ESP_LOGW(TAG, "Lost %lu frames, skipping to the next packet", (uint32_t)(front.key - expected_key_) + concealed_in_row_);
+    }
+
+    concealed_in_row_ = 0;
+    auto packet = std::move(front.packet);
+    expected_key_ = front.key + 1;
+    entries_.erase(entries_.begin());
+    depth_ = entries_.size();
+    last_sample_rate_ = packet->sample_rate;
+    last_frame_duration_ = packet->frame_duration;
+    return packet;
+}
+
+int AudioJitterBuffer::GetWaitTimeMs() const {
+    if (playing_ || entries_.empty()) {
+        return -1;
+    }
+    int frame_duration = GetFrameDuration(*entries_.front().packet);
+    int64_t start_us = buffering_since_us_ + static_cast<int64_t>(target_depth_) * frame_duration * 1000;
+    int64_t wait_ms = (start_us - esp_timer_get_time() + 999) / 1000;
+    return std::max<int64_t>(wait_ms, 1);
+}
+
+void AudioJitterBuffer::Reset() {
+    entries_.clear();
+    playing_ = false;
+    has_expected_ = false;
+    has_last_key_ = false;
+    has_local_key_ = false;
+    concealed_in_row_ = 0;
+    dry_since_us_ = 0;
+    depth_ = 0;
+}
+
+JitterBufferStats AudioJitterBuffer::GetStats() const {
+    JitterBufferStats stats;
+    stats.depth = depth_;
+    stats.target_depth = target_depth_;
+    stats.jitter_ms = jitter_ms_;
+    stats.late_packets = late_packets_;
+    stats.concealed_frames = concealed_frames_;
+    stats.underruns = underruns_;
+    return stats;
+}
@@ -0,0 +1,108 @@
+#ifndef AUDIO_JITTER_BUFFER_H
+#define AUDIO_JITTER_BUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include "protocol.h"
+
+#define JITTER_BUFFER_CAPACITY 16
+#define JITTER_BUFFER_MAX_TARGET_FRAMES 8
+// A sequence jump larger than this starts a new stream instead of being concealed
+#define JITTER_BUFFER_MAX_SEQUENCE_GAP 50
+#define JITTER_BUFFER_MAX_CONCEALED_FRAMES 3
+// Arrivals further apart than this are a new utterance, not jitter
+#define JITTER_BUFFER_ARRIVAL_RESET_MS 1000
+
+struct JitterBufferStats {
+    uint32_t depth = 0;             // Frames waiting in the jitter buffer
+    uint32_t target_depth = 0;      // Frames buffered before playback starts
+    uint32_t jitter_ms = 0;         // Smoothed arrival jitter
+    uint32_t late_packets = 0;      // Arrived after their frame was played or concealed
+    uint32_t concealed_frames = 0;  // Frames synthesized by Opus packet loss concealment
+    uint32_t underruns = 0;         // Times the buffer ran dry before the end of a stream
+};
+
+/*
+ * Reorders the downlink packets and decides when the next frame is played.
+ *
+ * OnPacketArrival() runs on the network side, for each packet the decode queue took, and
+ * only updates the jitter estimate.
+ * Everything else belongs to the decoder task: it inserts the packets popped from the
+ * decode queue and asks for the next frame whenever the playback queue has room.
+ *
+ * Packets are ordered by AudioStreamPacket::sequence. Packets without a sequence, local
+ * sounds or a server that does not number them, keep their arrival order in a stream of
+ * their own: a sound played during a sequenced stream starts once that stream runs out
+ * of queued frames, and the packets of it arriving later play after the sound.
+ * A missing frame is concealed once the speaker is about to run dry; the returned packet
+ * then has an empty payload, which makes the Opus decoder run its packet loss concealment.
+ *
+ * Running dry is also how every stream ends, so it only counts as an underrun once the
+ * same stream goes on: a packet that continues its sequence within
+ * JITTER_BUFFER_ARRIVAL_RESET_MS. A new stream, or a Reset(), leaves it uncounted.
+ */
+class AudioJitterBuffer {
+public:
+    AudioJitterBuffer();
+
+    // Network side, calls must be serialized
+    void OnPacketArrival(uint32_t sequence, int frame_duration);
+
+    // Decoder task side
+    bool full() const { return entries_.size() >= JITTER_BUFFER_CAPACITY; }
+    bool empty() const { return entries_.empty(); }
+    uint32_t depth() const { return depth_; }
+    void Insert(AudioStreamPacketPtr packet);
+    // deadline: the speaker has nothing queued, a missing frame must be concealed now
+    bool IsReady(bool deadline) const;
+    AudioStreamPacketPtr PopFrame(bool deadline);
+    // How long to wait before IsReady() may change without a new packet, -1 for never
+    int GetWaitTimeMs() const;
+    void Reset();
+
+    JitterBufferStats GetStats() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        AudioStreamPacketPtr packet;
+    };
+
+    std::vector<Entry> entries_;
+    bool playing_ = false;
+    bool has_expected_ = false;
+    bool has_last_key_ = false;
+    uint64_t expected_key_ = 0;
+    // The newest sequenced packet, and the stream it went into
+    uint64_t last_key_ = 0;
+    uint32_t stream_ = 0;
+    // The newest packet without a sequence
+    bool has_local_key_ = false;
+    uint64_t local_key_ = 0;
+    uint32_t last_stream_ = 0;
+    int concealed_in_row_ = 0;
+    // Ran dry at this time, an underrun if the stream goes on, 0 if not dry
+    int64_t dry_since_us_ = 0;
+    int64_t buffering_since_us_ = 0;
+    int last_sample_rate_ = 0;
+    int last_frame_duration_ = 0;
+
+    // Jitter estimate, written by the network side
+    int64_t last_arrival_us_ = 0;
+    uint32_t last_arrival_sequence_ = 0;
+    int jitter_q4_ = 0;
+    std::atomic<uint32_t> jitter_ms_ = 0;
+    std::atomic<uint32_t> target_depth_ = 1;
+
+    std::atomic<uint32_t> depth_ = 0;
+    std::atomic<uint32_t> late_packets_ = 0;
+    std::atomic<uint32_t> concealed_frames_ = 0;
+    std::atomic<uint32_t> underruns_ = 0;
+
+    bool IsStartReady() const;
+    uint64_t MakeKey(uint32_t stream, uint32_t sequence) const { return (static_cast<uint64_t>(stream) << 32) | sequence; }
+};
+
+#endif // AUDIO_JITTER_BUFFER_H
@@ -0,0 +1,128 @@
+#include "audio_latency.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <algorithm>
+
+#define TAG "AudioLatency"
+
+static const char* const kStageNames[kAudioLatencyStageCount] = {
+    "i2s_read",
+    "processor",
+    "encode",
+    "send_queue",
+    "send",
+    "decode",
+    "output",
+    "assembly",
+};
+
+const char* AudioLatencyStats::GetStageName(AudioLatencyStage stage) {
+    return kStageNames[stage];
+}
+
+int AudioLatencyHistogram::BucketOf(uint32_t us) {
+    if (us < 4) {
+        return us;
+    }
+    // The top three bits select the bucket: the octave and a quarter of it
+    int exponent = 31 - __builtin_clz(us);
+    int bucket = 4 * (exponent - 1) + ((us >> (exponent - 2)) & 3);
+    return bucket < kBucketCount ? bucket : kBucketCount - 1;
+}
+
+uint32_t AudioLatencyHistogram::BucketUpperBound(int bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    int shift = bucket / 4 - 1;
+    return ((uint32_t)(4 + bucket % 4 + 1) << shift) - 1;
+}
+
+void AudioLatencyHistogram::Record(int64_t us) {
+    uint32_t value = us < 0 ? 0 : (us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+    buckets_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    uint32_t max = max_us_.load(std::memory_order_relaxed);
+    while (value > max && !max_us_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint32_t AudioLatencyHistogram::Percentile(uint32_t count, int percent) const {
+    uint32_t rank = (count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return BucketUpperBound(i);
+        }
+    }
+    return BucketUpperBound(kBucketCount - 1);
+}
+
+AudioLatencySummary AudioLatencyHistogram::GetSummary() const {
+    AudioLatencySummary summary;
+    // The total is summed from the buckets, so the percentiles see a consistent count
+    uint32_t count = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        count += buckets_[i].load(std::memory_order_relaxed);
+    }
+    summary.count = count;
+    if (count == 0) {
+        return summary;
+    }
+    // A bucket bound can exceed the largest value recorded in it
+    summary.max_us = max_us_.load(std::memory_order_relaxed);
+    summary.p50_us = std::min(Percentile(count, 50), summary.max_us);
+    summary.p95_us = std::min(Percentile(count, 95), summary.max_us);
+    summary.p99_us = std::min(Percentile(count, 99), summary.max_us);
+    return summary;
+}
+
+void AudioLatencyHistogram::Reset() {
+    for (int i = 0; i < kBucketCount; i++) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    max_us_.store(0, std::memory_order_relaxed);
+}
+
+std::string AudioLatencyStats::GetJson() const {
+    /*
+        {
+            "encode": { "count": 120, "p50_us": 9, "p95_us": 13, "p99_us": 15, "max_us": 14210 },
+            ...
+        }
+    */
+    cJSON* root = cJSON_CreateObject();
+    for (int i = 0; i < kAudioLatencyStageCount; i++) {
+        auto summary = histograms_[i].GetSummary();
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", summary.count);
+        cJSON_AddNumberToObject(stage, "p50_us", summary.p50_us);
+        cJSON_AddNumberToObject(stage, "p95_us", summary.p95_us);
+        cJSON_AddNumberToObject(stage, "p99_us", summary.p99_us);
+        cJSON_AddNumberToObject(stage, "max_us", summary.max_us);
+        cJSON_AddItemToObject(root, kStageNames[i], stage);
+    }
+    char* json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void AudioLatencyStats::Print() const {
+    for (int i = 0; i < kAudioLatencyStageCount; i++) {
+        auto summary = histograms_[i].GetSummary();
+        if (summary.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s: %lu frames, p50 %lu us p95 %lu us p99 %lu us max %lu us", kStageNames[i],
+            summary.count, summary.p50_us, summary.p95_us, summary.p99_us, summary.max_us);
+    }
+}
+
+void AudioLatencyStats::Reset() {
+    for (auto& histogram : histograms_) {
+        histogram.Reset();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include <esp_timer.h>
+
+/*
+ * Pipeline stages timed per frame. Each stage is the time a frame spends between two
+ * stamps, so the uplink and downlink stages add up to the time spent on the device.
+ * kAudioLatencyAssembly splits out a part of kAudioLatencyProcessor and is not added.
+ */
+enum AudioLatencyStage {
+    kAudioLatencyI2sRead,       // codec_->InputData() call
+    kAudioLatencyProcessor,     // Last capture -> audio processor output (AFE fetch)
+    kAudioLatencyEncode,        // Processor output -> Opus packet (encode queue + encoder)
+    kAudioLatencySendQueue,     // Opus packet -> PopPacketFromSendQueue()
+    kAudioLatencySend,          // Protocol::SendAudio() call
+    kAudioLatencyDecode,        // Network receive -> PCM (decode queue + jitter buffer + decoder)
+    kAudioLatencyOutput,        // PCM -> codec_->OutputData() returned (playback queue + DMA write)
+    kAudioLatencyAssembly,      // AFE fetch -> full frame out of the processor, part of kAudioLatencyProcessor
+    kAudioLatencyStageCount,
+};
+
+struct AudioLatencySummary {
+    uint32_t count = 0;
+    uint32_t p50_us = 0;
+    uint32_t p95_us = 0;
+    uint32_t p99_us = 0;
+    uint32_t max_us = 0;
+};
+
+/*
+ * Log-scale latency histogram, four buckets per octave from 1 us to about 30 s.
+ *
+ * Record() is a few atomic increments and may run on any task. The percentiles are
+ * the upper bounds of their buckets, so they overestimate by less than 25%.
+ */
+class AudioLatencyHistogram {
+public:
+    static constexpr int kBucketCount = 96;
+
+    void Record(int64_t us);
+    AudioLatencySummary GetSummary() const;
+    void Reset();
+
+private:
+    std::atomic<uint32_t> buckets_[kBucketCount] = {};
+    std::atomic<uint32_t> max_us_ = 0;
+
+    static int BucketOf(uint32_t us);
+    static uint32_t BucketUpperBound(int bucket);
+    uint32_t Percentile(uint32_t count, int percent) const;
+};
+
+class AudioLatencyStats {
+public:
+    static AudioLatencyStats& GetInstance() {
+        static AudioLatencyStats instance;
+        return instance;
+    }
+
+    void Record(AudioLatencyStage stage, int64_t us) { histograms_[stage].Record(us); }
+    // Records the time since a stamp taken with esp_timer_get_time(), a zero stamp is skipped
+    void RecordSince(AudioLatencyStage stage, int64_t stamp_us) {
+        if (stamp_us > 0) {
+            histograms_[stage].Record(esp_timer_get_time() - stamp_us);
+        }
+    }
+    AudioLatencySummary GetSummary(AudioLatencyStage stage) const { return histograms_[stage].GetSummary(); }
+    static const char* GetStageName(AudioLatencyStage stage);
+    std::string GetJson() const;
+    void Print() const;
+    void Reset();
+
+private:
+    AudioLatencyStats() = default;
+    AudioLatencyHistogram histograms_[kAudioLatencyStageCount];
+};
+
+#endif // AUDIO_LATENCY_H
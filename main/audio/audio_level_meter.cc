@@ -0,0 +1,114 @@
+#include "audio_level_meter.h"
+#include "audio_dsp.h"
+
+#include <esp_log.h>
+
+#include <cmath>
+
+#define TAG "AudioLevelMeter"
+
+AudioLevelMeter::~AudioLevelMeter() {
+    if (timer_ != nullptr) {
+        esp_timer_stop(timer_);
+        esp_timer_delete(timer_);
+    }
+}
+
+uint32_t AudioLevelMeter::Measure(AudioLevelDirection direction, const int16_t* pcm, size_t frames, int channels) {
+    if (frames == 0) {
+        return 0;
+    }
+    uint64_t sum_squares;
+    int32_t peak;
+    AudioMeasureLevel(pcm, frames, channels, sum_squares, peak);
+    uint32_t mean_square = (uint32_t)(sum_squares / frames);
+    uint32_t rms = (uint32_t)std::sqrt((float)mean_square);
+
+    times_ms_[direction].store((uint32_t)(esp_timer_get_time() / 1000), std::memory_order_relaxed);
+    levels_[direction].store(rms | ((uint32_t)peak << 16), std::memory_order_release);
+    return mean_square;
+}
+
+AudioLevelSnapshot AudioLevelMeter::GetSnapshot() const {
+    AudioLevelSnapshot snapshot;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    AudioLevel* levels[kAudioLevelDirectionCount] = {&snapshot.input, &snapshot.output};
+    for (int i = 0; i < kAudioLevelDirectionCount; i++) {
+        uint32_t level = levels_[i].load(std::memory_order_acquire);
+        if (now_ms - times_ms_[i].load(std::memory_order_relaxed) > AUDIO_LEVEL_STALE_MS) {
+            continue;
+        }
+        levels[i]->rms = level & 0xFFFF;
+        levels[i]->peak = level >> 16;
+    }
+    return snapshot;
+}
+
+int AudioLevelMeter::Subscribe(std::function<void(const AudioLevelSnapshot&)> callback) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    for (int id = 0; id < AUDIO_LEVEL_MAX_SUBSCRIBERS; id++) {
+        if (!subscribers_[id]) {
+            subscribers_[id] = std::move(callback);
+            if (subscriber_count_++ == 0) {
+                RestartTimer();
+            }
+            return id;
+        }
+    }
+    ESP_LOGW(TAG, "No room for another level subscriber");
+    return -1;
+}
+
+void AudioLevelMeter::Unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    if (id < 0 || id >= AUDIO_LEVEL_MAX_SUBSCRIBERS || !subscribers_[id]) {
+        return;
+    }
+    subscribers_[id] = nullptr;
+    if (--subscriber_count_ == 0) {
+        esp_timer_stop(timer_);
+    }
+}
+
+void AudioLevelMeter::SetRate(int rate_hz) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    rate_hz_ = rate_hz > 0 ? rate_hz : CONFIG_AUDIO_LEVEL_METER_RATE_HZ;
+    if (subscriber_count_ > 0) {
+        RestartTimer();
+    }
+}
+
+int AudioLevelMeter::ToDbfs(uint16_t level) {
+    if (level == 0) {
+        return -96;
+    }
+    return (int)std::lround(20 * std::log10(level / 32768.0f));
+}
+
+void AudioLevelMeter::Publish() {
+    auto snapshot = GetSnapshot();
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    for (auto& subscriber : subscribers_) {
+        if (subscriber) {
+            subscriber(snapshot);
+        }
+    }
+}
+
+void AudioLevelMeter::RestartTimer() {
+    /* Created on the first subscription, the meter itself may be constructed before esp_timer runs */
+    if (timer_ == nullptr) {
+        esp_timer_create_args_t timer_args = {
+            .callback = [](void* arg) {
+                ((AudioLevelMeter*)arg)->Publish();
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "audio_level_meter",
+            .skip_unhandled_events = true,
+        };
+        esp_timer_create(&timer_args, &timer_);
+    }
+    esp_timer_stop(timer_);
+    esp_timer_start_periodic(timer_, 1000000 / rate_hz_);
+}
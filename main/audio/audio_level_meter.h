@@ -0,0 +1,78 @@
+#ifndef AUDIO_LEVEL_METER_H
+#define AUDIO_LEVEL_METER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+#include <esp_timer.h>
+
+// Rate of the subscriber callbacks, the option only exists in the project Kconfig
+#ifndef CONFIG_AUDIO_LEVEL_METER_RATE_HZ
+#define CONFIG_AUDIO_LEVEL_METER_RATE_HZ 20
+#endif
+// A direction not measured for this long reads as silent, e.g. the speaker after the playback
+#define AUDIO_LEVEL_STALE_MS 200
+#define AUDIO_LEVEL_MAX_SUBSCRIBERS 4
+
+enum AudioLevelDirection {
+    kAudioLevelInput,       // The microphone channel, as captured
+    kAudioLevelOutput,      // The PCM written to the speaker, after the mixer
+    kAudioLevelDirectionCount,
+};
+
+struct AudioLevel {
+    uint16_t rms = 0;       // Linear, full scale is 32768
+    uint16_t peak = 0;
+};
+
+struct AudioLevelSnapshot {
+    AudioLevel input;
+    AudioLevel output;
+};
+
+/*
+ * Audio levels for the UI, the LEDs and power management, measured once per frame where
+ * the capture and the playback stages already hold the PCM.
+ *
+ * Measure() runs AudioMeasureLevel() over the frame and publishes its RMS and peak in one
+ * 32-bit atomic per direction, next to the time of the frame, so GetSnapshot() is lock free
+ * from any task. The level and the time may come from two frames in a row, which only moves
+ * the staleness by a frame.
+ *
+ * Subscribers are called with the snapshot at CONFIG_AUDIO_LEVEL_METER_RATE_HZ from an
+ * esp_timer, which only runs while someone is subscribed. The callbacks run in the esp_timer
+ * task and must not block, nor subscribe or unsubscribe.
+ */
+class AudioLevelMeter {
+public:
+    ~AudioLevelMeter();
+
+    // From the stage owning the direction; measures the first of channels, returns the mean square
+    uint32_t Measure(AudioLevelDirection direction, const int16_t* pcm, size_t frames, int channels = 1);
+    AudioLevelSnapshot GetSnapshot() const;
+
+    // Returns the subscription id, -1 when AUDIO_LEVEL_MAX_SUBSCRIBERS are taken
+    int Subscribe(std::function<void(const AudioLevelSnapshot&)> callback);
+    void Unsubscribe(int id);
+    void SetRate(int rate_hz);
+
+    // -96 for silence
+    static int ToDbfs(uint16_t level);
+
+private:
+    std::atomic<uint32_t> levels_[kAudioLevelDirectionCount] = {};     // rms | peak << 16
+    std::atomic<uint32_t> times_ms_[kAudioLevelDirectionCount] = {};
+    std::mutex subscribers_mutex_;
+    std::function<void(const AudioLevelSnapshot&)> subscribers_[AUDIO_LEVEL_MAX_SUBSCRIBERS];
+    int subscriber_count_ = 0;
+    int rate_hz_ = CONFIG_AUDIO_LEVEL_METER_RATE_HZ;
+    esp_timer_handle_t timer_ = nullptr;
+
+    void Publish();
+    void RestartTimer();
+};
+
+#endif // AUDIO_LEVEL_METER_H
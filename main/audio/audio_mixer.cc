@@ -0,0 +1,53 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+
+void AudioMixer::AddVoice(const int16_t* pcm, size_t samples, int32_t gain) {
+    if (pcm == nullptr || samples == 0) {
+        return;
+    }
+    if (voice_count_ == AUDIO_MIXER_MAX_VOICES) {
+        std::copy(voices_ + 1, voices_ + voice_count_, voices_);
+        voice_count_--;
+    }
+    voices_[voice_count_++] = {pcm, samples, 0, gain};
+}
+
+void AudioMixer::Feed(const int16_t* pcm, size_t samples) {
+    /* What is left of the last frame moves to the front, at most a frame of samples */
+    fed_.erase(fed_.begin(), fed_.begin() + fed_position_);
+    fed_position_ = 0;
+    fed_.insert(fed_.end(), pcm, pcm + samples);
+}
+
+void AudioMixer::Mix(int16_t* frame, size_t samples) {
+    /* Duck the stream under the voices, and bring it back once they end */
+    int32_t target_gain = HasVoices() ? AUDIO_MIXER_DUCK_GAIN_Q15 : AUDIO_GAIN_UNITY_Q15;
+    if (stream_gain_ != AUDIO_GAIN_UNITY_Q15 || target_gain != AUDIO_GAIN_UNITY_Q15) {
+        AudioApplyGainRamp(frame, samples, stream_gain_, target_gain);
+        stream_gain_ = target_gain;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < voice_count_; i++) {
+        Voice& voice = voices_[i];
+        size_t count = std::min(samples, voice.samples - voice.position);
+        AudioMixInto(frame, voice.pcm + voice.position, count, voice.gain);
+        voice.position += count;
+        if (voice.position < voice.samples) {
+            voices_[kept++] = voice;
+        }
+    }
+    voice_count_ = kept;
+
+    size_t count = std::min(samples, fed_samples());
+    AudioMixInto(frame, fed_.data() + fed_position_, count, AUDIO_GAIN_UNITY_Q15);
+    fed_position_ += count;
+}
+
+void AudioMixer::Reset() {
+    voice_count_ = 0;
+    fed_.clear();
+    fed_position_ = 0;
+    stream_gain_ = AUDIO_GAIN_UNITY_Q15;
+}
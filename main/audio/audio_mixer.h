@@ -0,0 +1,53 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "audio_dsp.h"
+
+#define AUDIO_MIXER_MAX_VOICES 4
+// The stream (TTS) is lowered to this while a voice plays over it, about -12 dB
+#define AUDIO_MIXER_DUCK_GAIN_Q15 8192
+
+/*
+ * Mixes short PCM voices, the cached UI sounds, into the playback stream.
+ *
+ * The stream frames come from the decoder; Mix() adds the playing voices on top with
+ * saturating fixed-point sums and ducks the stream while any voice plays, ramping the
+ * gain across a frame so the change does not click. A voice advances by the length of
+ * each frame it is mixed into, and when no stream frame is available the caller mixes
+ * into silence, so a voice never waits for the stream.
+ *
+ * The sounds that are not cached are decoded while they play: their frames are appended
+ * with Feed() and play on as one more voice, without a gap as long as they come in time.
+ *
+ * Not thread safe, owned by the audio output task.
+ */
+class AudioMixer {
+public:
+    // The samples must stay valid until the voice ends or Reset(), a full mixer replaces its oldest voice
+    void AddVoice(const int16_t* pcm, size_t samples, int32_t gain = AUDIO_GAIN_UNITY_Q15);
+    // Copies the frame, it plays right after the PCM fed before
+    void Feed(const int16_t* pcm, size_t samples);
+    size_t fed_samples() const { return fed_.size() - fed_position_; }
+    bool HasVoices() const { return voice_count_ > 0 || fed_samples() > 0; }
+    void Mix(int16_t* frame, size_t samples);
+    void Reset();
+
+private:
+    struct Voice {
+        const int16_t* pcm;
+        size_t samples;
+        size_t position;
+        int32_t gain;
+    };
+    Voice voices_[AUDIO_MIXER_MAX_VOICES];
+    int voice_count_ = 0;
+    std::vector<int16_t> fed_;
+    size_t fed_position_ = 0;
+    int32_t stream_gain_ = AUDIO_GAIN_UNITY_Q15;
+};
+
+#endif // AUDIO_MIXER_H
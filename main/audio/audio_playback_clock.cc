@@ -0,0 +1,37 @@
+#include "audio_playback_clock.h"
+
+void AudioPlaybackClock::SetSampleRate(int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sample_rate_ = sample_rate;
+}
+
+void AudioPlaybackClock::AddFrame(uint64_t position, size_t samples, uint32_t timestamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ == AUDIO_PLAYBACK_CLOCK_MAX_FRAMES) {
+        head_ = (head_ + 1) % AUDIO_PLAYBACK_CLOCK_MAX_FRAMES;
+        count_--;
+    }
+    frames_[(head_ + count_) % AUDIO_PLAYBACK_CLOCK_MAX_FRAMES] = {position, samples, timestamp};
+    count_++;
+}
+
+uint32_t AudioPlaybackClock::GetTimestamp(uint64_t position) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Newest first, the position is usually in one of the last frames written
+    for (size_t i = count_; i > 0; i--) {
+        const Frame& frame = frames_[(head_ + i - 1) % AUDIO_PLAYBACK_CLOCK_MAX_FRAMES];
+        if (position >= frame.position + frame.samples) {
+            return 0;
+        }
+        if (position >= frame.position) {
+            return frame.timestamp + (uint32_t)((position - frame.position) * 1000 / sample_rate_);
+        }
+    }
+    return 0;
+}
+
+void AudioPlaybackClock::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head_ = 0;
+    count_ = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef AUDIO_PLAYBACK_CLOCK_H
+#define AUDIO_PLAYBACK_CLOCK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+// Stream frames remembered, enough to cover the DMA buffer and an uplink frame of capture delay
+#define AUDIO_PLAYBACK_CLOCK_MAX_FRAMES 16
+
+/*
+ * Maps the output position of the codec back to the stream timestamps of the server.
+ *
+ * The output task adds each decoded frame with the codec position of its first sample
+ * before writing it. GetTimestamp() then finds the frame holding any later position and
+ * interpolates the timestamp of that very sample, so a capture time converted with
+ * AudioCodec::GetOutputPosition() gives the server the audio that was leaving the DAC.
+ * Positions in silence or in the cached sounds have no timestamp.
+ */
+class AudioPlaybackClock {
+public:
+    void SetSampleRate(int sample_rate);
+    // timestamp is the stream time of the first sample in milliseconds
+    void AddFrame(uint64_t position, size_t samples, uint32_t timestamp);
+    // Stream time of the sample at position in milliseconds, 0 when it is not part of the stream
+    uint32_t GetTimestamp(uint64_t position);
+    void Reset();
+
+private:
+    struct Frame {
+        uint64_t position;
+        size_t samples;
+        uint32_t timestamp;
+    };
+
+    std::mutex mutex_;
+    int sample_rate_ = 16000;
+    Frame frames_[AUDIO_PLAYBACK_CLOCK_MAX_FRAMES];
+    size_t head_ = 0;
+    size_t count_ = 0;
+};
+
+#endif // AUDIO_PLAYBACK_CLOCK_H
@@ -0,0 +1,123 @@
+#ifndef AUDIO_POOL_H
+#define AUDIO_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_log.h>
+
+template <typename T>
+class AudioObjectPool;
+
+/*
+ * Returns pooled objects to their pool, and deletes objects that did not come from one.
+ * It converts from std::default_delete, so a std::make_unique result can be passed
+ * wherever a pooled pointer is expected.
+ */
+template <typename T>
+struct AudioPoolDeleter {
+    AudioObjectPool<T>* pool = nullptr;
+
+    AudioPoolDeleter() = default;
+    explicit AudioPoolDeleter(AudioObjectPool<T>* pool) : pool(pool) {}
+    AudioPoolDeleter(const std::default_delete<T>&) {}
+
+    void operator()(T* object) const;
+};
+
+template <typename T>
+using AudioPoolPtr = std::unique_ptr<T, AudioPoolDeleter<T>>;
+
+struct AudioPoolStats {
+    uint32_t capacity = 0;
+    uint32_t in_use = 0;
+    uint32_t peak_in_use = 0;
+    uint32_t exhausted = 0;     // Acquire() calls that fell back to the heap
+};
+
+/*
+ * Fixed-capacity pool of recycled objects.
+ *
+ * The objects keep their buffers (vector capacity) across uses, so once the pool is warm
+ * a streaming pipeline makes no heap allocations. When the pool is exhausted, Acquire()
+ * falls back to a heap object and counts it, it never fails.
+ */
+template <typename T>
+class AudioObjectPool {
+public:
+    // recycle resets an object before it goes back to the free list, it must keep the buffers
+    AudioObjectPool(const char* name, std::function<void(T&)> recycle) : name_(name), recycle_(recycle) {}
+    AudioObjectPool(const AudioObjectPool&) = delete;
+    AudioObjectPool& operator=(const AudioObjectPool&) = delete;
+
+    void Reserve(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.reserve(capacity);
+        while (storage_.size() < capacity) {
+            storage_.push_back(std::make_unique<T>());
+            free_.push_back(storage_.back().get());
+        }
+    }
+
+    AudioPoolPtr<T> Acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                T* object = free_.back();
+                free_.pop_back();
+                uint32_t in_use = storage_.size() - free_.size();
+                if (in_use > peak_in_use_) {
+                    peak_in_use_ = in_use;
+                }
+                return AudioPoolPtr<T>(object, AudioPoolDeleter<T>(this));
+            }
+            if (exhausted_++ % 100 == 0) {
+                ESP_LOGW("AudioPool", "%s pool exhausted (capacity %u), allocating from heap (%lu times)",
+                    name_, storage_.size(), exhausted_);
+            }
+        }
+        return AudioPoolPtr<T>(new T());
+    }
+
+    AudioPoolStats GetStats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AudioPoolStats stats;
+        stats.capacity = storage_.size();
+        stats.in_use = storage_.size() - free_.size();
+        stats.peak_in_use = peak_in_use_;
+        stats.exhausted = exhausted_;
+        return stats;
+    }
+
+private:
+    friend struct AudioPoolDeleter<T>;
+
+    const char* name_;
+    std::function<void(T&)> recycle_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<T>> storage_;
+    std::vector<T*> free_;
+    uint32_t peak_in_use_ = 0;
+    uint32_t exhausted_ = 0;
+
+    void Release(T* object) {
+        recycle_(*object);
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(object);
+    }
+};
+
+template <typename T>
+void AudioPoolDeleter<T>::operator()(T* object) const {
+    if (pool != nullptr) {
+        pool->Release(object);
+    } else {
+        delete object;
+    }
+}
+
+#endif // AUDIO_POOL_H
@@ -8,11 +8,19 @@
 #include <model_path.h>
 #include "audio_codec.h"
 
+struct AudioProcessorStats {
+    uint32_t frames = 0;
+    uint32_t afe_overruns = 0;          // Fetches that found the AFE input ring full
+    uint32_t assembler_overruns = 0;    // Times output audio was dropped before it made a frame
+};
+
 class AudioProcessor {
 public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) = 0;
+    // Changes the duration of the output frames, applies from the next frame
+    virtual void SetFrameDuration(int frame_duration_ms) = 0;
     virtual void Feed(std::vector<int16_t>&& data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
@@ -21,6 +29,7 @@ public:
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EnableDeviceAec(bool enable) = 0;
+    virtual AudioProcessorStats GetStats() = 0;
 };
 
 #endif
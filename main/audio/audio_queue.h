@@ -0,0 +1,162 @@
+#ifndef AUDIO_QUEUE_H
+#define AUDIO_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A wake-up point shared by one or more queues.
+ *
+ * Notify() is a fence and an atomic load unless somebody is actually sleeping,
+ * so the producers and consumers on the audio hot path never touch a mutex
+ * while the pipeline is flowing.
+ */
+class AudioQueueEvent {
+public:
+    AudioQueueEvent() = default;
+    AudioQueueEvent(const AudioQueueEvent&) = delete;
+    AudioQueueEvent& operator=(const AudioQueueEvent&) = delete;
+
+    void Notify() {
+        // Pairs with the fence in Wait(): either the waiter sees our update or we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_all();
+    }
+
+    template <typename Predicate>
+    void Wait(Predicate ready) {
+        if (ready()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait(lock, ready);
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Returns the result of the predicate, false if the timeout expired first
+    template <typename Predicate>
+    bool WaitFor(int timeout_ms, Predicate ready) {
+        if (ready()) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool result = cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    std::atomic<int> waiters_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+/*
+ * Bounded single-producer / single-consumer ring.
+ *
+ * TryPush() must only be called by one producer at a time and Pop() by one consumer.
+ * Clear() may be called from any task: it marks everything pushed so far as flushed,
+ * and the consumer drops the flushed items on its next Pop(). Until then they still
+ * occupy their slots, so full() may be true while size() is zero.
+ */
+template <typename T>
+class AudioRingQueue {
+public:
+    AudioRingQueue(size_t capacity, AudioQueueEvent* readable_event, AudioQueueEvent* writable_event)
+        : slots_(capacity), readable_event_(readable_event), writable_event_(writable_event) {
+    }
+    AudioRingQueue(const AudioRingQueue&) = delete;
+    AudioRingQueue& operator=(const AudioRingQueue&) = delete;
+
+    // Producer side. The item is only moved from if the push succeeds.
+    bool TryPush(T&& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= slots_.size()) {
+            return false;
+        }
+        slots_[head % slots_.size()] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        if (readable_event_ != nullptr) {
+            readable_event_->Notify();
+        }
+        return true;
+    }
+
+    // Consumer side. Returns false if there is no pending (non-flushed) item.
+    bool Pop(T& item) {
+        const uint32_t start = tail_.load(std::memory_order_relaxed);
+        uint32_t tail = start;
+        bool popped = false;
+        while (tail != head_.load(std::memory_order_acquire)) {
+            T value = std::move(slots_[tail % slots_.size()]);
+            bool flushed = IsBefore(tail, flush_mark_.load(std::memory_order_acquire));
+            tail_.store(++tail, std::memory_order_release);
+            if (!flushed) {
+                item = std::move(value);
+                popped = true;
+                break;
+            }
+        }
+        if (writable_event_ != nullptr && tail != start) {
+            writable_event_->Notify();
+        }
+        return popped;
+    }
+
+    void Clear() {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t mark = flush_mark_.load(std::memory_order_relaxed);
+        while (IsBefore(mark, head) && !flush_mark_.compare_exchange_weak(mark, head, std::memory_order_acq_rel)) {
+        }
+        // Wake the consumer to drop the flushed items, and the producer waiting for logical space
+        if (readable_event_ != nullptr) {
+            readable_event_->Notify();
+        }
+        if (writable_event_ != nullptr) {
+            writable_event_->Notify();
+        }
+    }
+
+    // Number of pending items, excluding flushed ones
+    size_t size() const {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t mark = flush_mark_.load(std::memory_order_acquire);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (IsBefore(tail, mark)) {
+            tail = mark;
+        }
+        return IsBefore(tail, head) ? head - tail : 0;
+    }
+    bool empty() const { return size() == 0; }
+    // True if Pop() has work to do, including dropping flushed items
+    bool readable() const { return tail_.load(std::memory_order_acquire) != head_.load(std::memory_order_acquire); }
+    // True if TryPush() would fail
+    bool full() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire) >= slots_.size(); }
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T> slots_;
+    AudioQueueEvent* readable_event_;
+    AudioQueueEvent* writable_event_;
+    // Free-running indices, the slot is index % capacity
+    std::atomic<uint32_t> head_ = 0;
+    std::atomic<uint32_t> tail_ = 0;
+    std::atomic<uint32_t> flush_mark_ = 0;
+
+    static bool IsBefore(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+};
+
+#endif // AUDIO_QUEUE_H
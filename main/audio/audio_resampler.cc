@@ -0,0 +1,156 @@
+#include "audio_resampler.h"
+#include "audio_dsp.h"
+
+#include <esp_log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define TAG "AudioResampler"
+
+struct AudioResamplerTier {
+    int taps;           // Per phase, before the decimation scaling
+    double rolloff;     // Pass band edge over the Nyquist frequency of the lower rate
+    double beta;        // Kaiser window, sets the stop band attenuation
+};
+
+// Stop band attenuation, the Q15 taps put a floor at about 80 dB
+static const AudioResamplerTier kTiers[] = {
+    {8, 0.80, 5.0},     // About 50 dB
+    {16, 0.88, 7.0},    // About 70 dB
+    {32, 0.92, 8.0},    // About 80 dB, with the narrowest transition band
+};
+
+static int Gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+void AudioResampler::Configure(int input_sample_rate, int output_sample_rate, AudioResamplerQuality quality) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    int gcd = Gcd(input_sample_rate, output_sample_rate);
+    up_ = output_sample_rate / gcd;
+    down_ = input_sample_rate / gcd;
+    next_input_ = 0;
+    next_phase_ = 0;
+    if (up_ == down_) {
+        taps_ = 0;
+        coefficients_.clear();
+        history_.clear();
+        return;
+    }
+
+    // Decimating filters need proportionally more input taps for the same transition band
+    const auto& tier = kTiers[quality];
+    taps_ = tier.taps * std::max(1, (down_ + up_ - 1) / up_);
+    const int length = taps_ * up_;
+    // Cut-off in cycles per sample of the upsampled rate
+    const double cutoff = tier.rolloff * 0.5 * std::min(input_sample_rate, output_sample_rate) /
+        ((double)input_sample_rate * up_);
+    const double center = (length - 1) / 2.0;
+    const double window_norm = BesselI0(tier.beta);
+
+    std::vector<double> prototype(length);
+    for (int n = 0; n < length; n++) {
+        double t = n - center;
+        double x = 2.0 * cutoff * t;
+        double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+        double r = t / (center + 1.0);
+        double window = BesselI0(tier.beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / window_norm;
+        prototype[n] = 2.0 * cutoff * sinc * window;
+    }
+
+    // Each phase is normalized to unity gain at DC, and stored reversed for the dot product
+    coefficients_.assign(up_ * taps_, 0);
+    for (int p = 0; p < up_; p++) {
+        double sum = 0;
+        for (int k = 0; k < taps_; k++) {
+            sum += prototype[k * up_ + p];
+        }
+        for (int k = 0; k < taps_; k++) {
+            double value = prototype[k * up_ + p] / sum * AUDIO_GAIN_UNITY_Q15;
+            coefficients_[p * taps_ + (taps_ - 1 - k)] = AudioSaturate16((int32_t)std::lround(value));
+        }
+    }
+    history_.assign(taps_ - 1, 0);
+
+    ESP_LOGI(TAG, "Resampling %d -> %d Hz (%d/%d), %d taps per phase", input_sample_rate, output_sample_rate,
+        up_, down_, taps_);
+}
+
+int AudioResampler::GetOutputSamples(int input_samples) const {
+    if (up_ == down_) {
+        return input_samples;
+    }
+    int64_t position = (int64_t)next_input_ * up_ + next_phase_;
+    int64_t end = (int64_t)input_samples * up_;
+    return position < end ? (int)((end - position + down_ - 1) / down_) : 0;
+}
+
+void AudioResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    if (up_ == down_) {
+        memmove(output, input, input_samples * sizeof(int16_t));
+        return;
+    }
+
+    // x[i] .. x[i + taps_ - 1] are the taps_ input samples ending at input sample i
+    const size_t kept = taps_ - 1;
+    history_.resize(kept + input_samples);
+    memcpy(history_.data() + kept, input, input_samples * sizeof(int16_t));
+    const int16_t* x = history_.data();
+    const int16_t* h = coefficients_.data();
+
+    int i = next_input_;
+    int p = next_phase_;
+    if (up_ == 1) {
+        // Integer decimation, a single phase
+        for (; i < input_samples; i += down_) {
+            *output++ = AudioSaturate16((AudioDotProduct16(x + i, h, taps_) + (1 << 14)) >> 15);
+        }
+    } else if (down_ == 1) {
+        // Integer interpolation, every phase on each input sample
+        for (; i < input_samples; i++) {
+            for (int phase = 0; phase < up_; phase++) {
+                *output++ = AudioSaturate16((AudioDotProduct16(x + i, h + phase * taps_, taps_) + (1 << 14)) >> 15);
+            }
+        }
+    } else {
+        while (i < input_samples) {
+            *output++ = AudioSaturate16((AudioDotProduct16(x + i, h + p * taps_, taps_) + (1 << 14)) >> 15);
+            p += down_;
+            i += p / up_;
+            p %= up_;
+        }
+    }
+    next_input_ = i - input_samples;
+    next_phase_ = p;
+
+    // Keep the tail for the next call, the vector keeps its capacity
+    memmove(history_.data(), history_.data() + input_samples, kept * sizeof(int16_t));
+    history_.resize(kept);
+}
+
+void AudioResampler::Reset() {
+    std::fill(history_.begin(), history_.end(), 0);
+    next_input_ = 0;
+    next_phase_ = 0;
+}
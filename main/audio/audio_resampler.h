@@ -0,0 +1,63 @@
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <vector>
+#include <cstdint>
+
+enum AudioResamplerQuality {
+    kAudioResamplerQualityLow,      // 8 taps per phase, for the capture paths on slow cores
+    kAudioResamplerQualityMedium,   // 16 taps per phase
+    kAudioResamplerQualityHigh,     // 32 taps per phase
+};
+
+#if CONFIG_AUDIO_RESAMPLER_QUALITY_LOW
+#define AUDIO_RESAMPLER_DEFAULT_QUALITY kAudioResamplerQualityLow
+#elif CONFIG_AUDIO_RESAMPLER_QUALITY_HIGH
+#define AUDIO_RESAMPLER_DEFAULT_QUALITY kAudioResamplerQualityHigh
+#else
+#define AUDIO_RESAMPLER_DEFAULT_QUALITY kAudioResamplerQualityMedium
+#endif
+
+/*
+ * Polyphase FIR resampler for mono 16-bit PCM, a drop-in for OpusResampler.
+ *
+ * The rate ratio is reduced to L / M and a Kaiser-windowed sinc low-pass is split into
+ * L phases of Q15 coefficients when configured. Each output sample is one dot product
+ * of a phase with the last input samples, so there is no per-frame allocation and no
+ * floating point in Process(). Integer ratios skip the phase stepping: 48 -> 16 kHz
+ * computes every third output position only, 16 -> 48 kHz runs all phases on each input.
+ *
+ * It keeps the tail of the input between calls, so a stream can be cut into frames of
+ * any size. GetOutputSamples() is exact for the next Process() call.
+ *
+ * Not thread safe, each stream needs its own instance.
+ */
+class AudioResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate,
+        AudioResamplerQuality quality = AUDIO_RESAMPLER_DEFAULT_QUALITY);
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+    int GetOutputSamples(int input_samples) const;
+    // Forgets the input kept from the previous calls, for a new stream
+    void Reset();
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+    int taps() const { return taps_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int up_ = 1;                    // L
+    int down_ = 1;                  // M
+    int taps_ = 0;                  // Per phase
+    // Phase p holds its taps reversed, oldest input first: coefficients_[p * taps_ + k]
+    std::vector<int16_t> coefficients_;
+    // The last taps_ - 1 input samples followed by the input of the current call
+    std::vector<int16_t> history_;
+    // Position of the next output: input sample index relative to the next call, and phase
+    int next_input_ = 0;
+    int next_phase_ = 0;
+};
+
+#endif // AUDIO_RESAMPLER_H
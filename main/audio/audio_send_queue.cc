@@ -0,0 +1,161 @@
+#include "audio_send_queue.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioSendQueue"
+
+AudioSendQueue::AudioSendQueue(size_t slot_capacity, int max_duration_ms, AudioSendQueuePolicy policy,
+    AudioQueueEvent* writable_event)
+    : slots_(slot_capacity), infos_(slot_capacity), states_(new std::atomic<uint8_t>[slot_capacity]),
+      max_duration_ms_(max_duration_ms), policy_(policy), writable_event_(writable_event) {
+    for (size_t i = 0; i < slot_capacity; i++) {
+        states_[i].store(kTaken, std::memory_order_relaxed);
+    }
+}
+
+bool AudioSendQueue::Push(AudioStreamPacketPtr&& packet, bool voice) {
+    Reclaim();
+    const int duration = packet->frame_duration;
+    if (queued_ms_ <= max_duration_ms_ / 2) {
+        congested_ = false;
+    }
+    if (policy_ != kAudioSendQueueBlock) {
+        while (queued_ms_ + duration > max_duration_ms_ && DropOne()) {
+        }
+    } else if (queued_ms_ + duration > max_duration_ms_) {
+        CountDrop(duration, voice);
+        return false;
+    }
+
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= slots_.size()) {
+        // The consumer has not taken anything for a whole ring, the new packet is the one lost
+        overflows_.fetch_add(1, std::memory_order_relaxed);
+        CountDrop(duration, voice);
+        return false;
+    }
+    size_t slot = head % slots_.size();
+    infos_[slot] = {(uint16_t)duration, voice, false};
+    slots_[slot] = std::move(packet);
+    states_[slot].store(kQueued, std::memory_order_relaxed);
+    queued_ms_ += duration;
+    if ((uint32_t)queued_ms_ > peak_ms_.load(std::memory_order_relaxed)) {
+        peak_ms_.store(queued_ms_, std::memory_order_relaxed);
+    }
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool AudioSendQueue::HasRoom(int frame_duration) {
+    Reclaim();
+    return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire) < slots_.size() &&
+        queued_ms_ + frame_duration <= max_duration_ms_;
+}
+
+int AudioSendQueue::duration_ms() {
+    Reclaim();
+    return queued_ms_;
+}
+
+bool AudioSendQueue::Pop(AudioStreamPacketPtr& packet) {
+    const uint32_t start = tail_.load(std::memory_order_relaxed);
+    uint32_t tail = start;
+    bool popped = false;
+    while (tail != head_.load(std::memory_order_acquire)) {
+        size_t slot = tail % slots_.size();
+        uint8_t state = kQueued;
+        if (states_[slot].compare_exchange_strong(state, kTaken, std::memory_order_acq_rel)) {
+            packet = std::move(slots_[slot]);
+            tail_.store(++tail, std::memory_order_release);
+            popped = true;
+            break;
+        }
+        // Dropped, the producer released the packet already
+        tail_.store(++tail, std::memory_order_release);
+        pending_drops_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (writable_event_ != nullptr && tail != start) {
+        writable_event_->Notify();
+    }
+    return popped;
+}
+
+size_t AudioSendQueue::size() const {
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    uint32_t head = head_.load(std::memory_order_acquire);
+    uint32_t dropped = pending_drops_.load(std::memory_order_relaxed);
+    return head - tail > dropped ? head - tail - dropped : 0;
+}
+
+AudioSendQueueStats AudioSendQueue::GetStats() const {
+    AudioSendQueueStats stats;
+    stats.dropped_frames = dropped_frames_;
+    stats.dropped_ms = dropped_ms_;
+    stats.dropped_voice_ms = dropped_voice_ms_;
+    stats.congestions = congestions_;
+    stats.overflows = overflows_;
+    stats.peak_ms = peak_ms_;
+    return stats;
+}
+
+void AudioSendQueue::Reclaim() {
+    /* The consumer is past these, sent or skipped, the released ones were taken off already */
+    const uint32_t tail = tail_.load(std::memory_order_acquire);
+    for (; accounted_tail_ != tail; accounted_tail_++) {
+        const auto& info = infos_[accounted_tail_ % slots_.size()];
+        if (!info.released) {
+            queued_ms_ -= info.duration_ms;
+        }
+    }
+}
+
+bool AudioSendQueue::DropOne() {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t victim = head;
+    for (uint32_t index = accounted_tail_; index != head; index++) {
+        const auto& info = infos_[index % slots_.size()];
+        if (info.released) {
+            continue;
+        }
+        if (victim == head) {
+            victim = index;
+        }
+        if (policy_ == kAudioSendQueueDropOldest || !info.voice) {
+            victim = index;
+            break;
+        }
+    }
+    if (victim == head) {
+        return false;
+    }
+
+    const size_t slot = victim % slots_.size();
+    auto& info = infos_[slot];
+    info.released = true;
+    queued_ms_ -= info.duration_ms;
+    // Counted first, so the consumer never takes it off below zero
+    pending_drops_.fetch_add(1, std::memory_order_relaxed);
+    uint8_t state = kQueued;
+    if (!states_[slot].compare_exchange_strong(state, kDropped, std::memory_order_acq_rel)) {
+        // The consumer is sending it, it leaves the queue anyway
+        pending_drops_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    // The slot is ours until it is reused, the pool gets the packet back now
+    slots_[slot].reset();
+    CountDrop(info.duration_ms, info.voice);
+    if (!congested_) {
+        congested_ = true;
+        congestions_++;
+        ESP_LOGW(TAG, "Uplink congested, dropping queued %s audio", info.voice ? "voice" : "silent");
+    }
+    return true;
+}
+
+void AudioSendQueue::CountDrop(int duration_ms, bool voice) {
+    dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+    dropped_ms_.fetch_add(duration_ms, std::memory_order_relaxed);
+    if (voice) {
+        dropped_voice_ms_.fetch_add(duration_ms, std::memory_order_relaxed);
+    }
+}
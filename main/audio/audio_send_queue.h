@@ -0,0 +1,109 @@
+#ifndef AUDIO_SEND_QUEUE_H
+#define AUDIO_SEND_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "audio_queue.h"
+#include "protocol.h"
+
+enum AudioSendQueuePolicy {
+    kAudioSendQueueDropOldest,          // Drop the oldest frames to make room for the new one
+    kAudioSendQueueDropSilenceFirst,    // Drop the oldest frames without speech first, then the oldest
+    kAudioSendQueueBlock,               // Hold the encoder until the uplink catches up
+};
+
+struct AudioSendQueueStats {
+    uint32_t dropped_frames = 0;
+    uint32_t dropped_ms = 0;
+    uint32_t dropped_voice_ms = 0;  // ... of which the VAD reported speech
+    uint32_t congestions = 0;       // Times the queue went from draining to dropping
+    uint32_t overflows = 0;         // ... of the dropped frames, new ones that found the ring full
+    uint32_t peak_ms = 0;           // Most audio queued
+};
+
+/*
+ * The uplink queue between the opus encoder task and the task sending the packets, bounded
+ * by the milliseconds of audio it holds rather than by the packet count.
+ *
+ * Under the drop policies Push() never fails for lack of room, so a stalled uplink costs
+ * audio instead of stalling the capture: a packet that would take the queue past the bound
+ * first drops older ones. As in AudioRingQueue, only the consumer advances the tail, so a
+ * dropped packet keeps its slot until Pop() skips it. Each slot has a state that the producer
+ * and the consumer claim it with: the consumer to send the packet, the producer to drop it
+ * and release it to the pool right away, so the packets held never exceed the bound however
+ * long the consumer is stuck in a send.
+ *
+ * The empty slots of the dropped packets cost a pointer each, the ring has room for
+ * slot_capacity of them. If the consumer takes nothing for that long, the ring is full of
+ * them and the new packet is dropped instead of the oldest; it is counted as an overflow.
+ *
+ * The producer keeps the duration and the voice flag of each slot, only the states are shared.
+ */
+class AudioSendQueue {
+public:
+    AudioSendQueue(size_t slot_capacity, int max_duration_ms, AudioSendQueuePolicy policy, AudioQueueEvent* writable_event);
+    AudioSendQueue(const AudioSendQueue&) = delete;
+    AudioSendQueue& operator=(const AudioSendQueue&) = delete;
+
+    // Producer side. False if the packet was dropped: the ring was full, or the bound is reached under kAudioSendQueueBlock
+    bool Push(AudioStreamPacketPtr&& packet, bool voice);
+    // Producer side. Whether a frame of this duration fits within the bound without dropping
+    bool HasRoom(int frame_duration);
+    // Producer side. Audio queued and not dropped
+    int duration_ms();
+
+    // Consumer side. Returns false if there is no packet left to send
+    bool Pop(AudioStreamPacketPtr& packet);
+
+    // Number of packets queued and not dropped, from any task
+    size_t size() const;
+    AudioSendQueuePolicy policy() const { return policy_; }
+    AudioSendQueueStats GetStats() const;
+
+private:
+    // Producer-owned bookkeeping of a slot
+    struct SlotInfo {
+        uint16_t duration_ms = 0;
+        bool voice = false;
+        bool released = false;      // Dropped, or found taken while dropping: out of queued_ms_
+    };
+    // Claimed from kQueued by the consumer (kTaken) or by the producer (kDropped)
+    enum : uint8_t {
+        kQueued = 0,
+        kTaken,
+        kDropped,
+    };
+
+    std::vector<AudioStreamPacketPtr> slots_;
+    std::vector<SlotInfo> infos_;
+    std::unique_ptr<std::atomic<uint8_t>[]> states_;
+    const int max_duration_ms_;
+    const AudioSendQueuePolicy policy_;
+    AudioQueueEvent* writable_event_;
+    // Free-running indices, the slot is index % capacity
+    std::atomic<uint32_t> head_ = 0;
+    std::atomic<uint32_t> tail_ = 0;
+    // Dropped packets whose slots Pop() has not skipped yet, so size() can leave them out
+    std::atomic<uint32_t> pending_drops_ = 0;
+    // Producer state: the tail it accounted up to and the audio queued from there
+    uint32_t accounted_tail_ = 0;
+    int queued_ms_ = 0;
+    bool congested_ = false;
+
+    std::atomic<uint32_t> dropped_frames_ = 0;
+    std::atomic<uint32_t> dropped_ms_ = 0;
+    std::atomic<uint32_t> dropped_voice_ms_ = 0;
+    std::atomic<uint32_t> congestions_ = 0;
+    std::atomic<uint32_t> peak_ms_ = 0;
+    std::atomic<uint32_t> overflows_ = 0;
+
+    void Reclaim();
+    bool DropOne();
+    void CountDrop(int duration_ms, bool voice);
+};
+
+#endif // AUDIO_SEND_QUEUE_H
@@ -1,6 +1,9 @@
 #include "audio_service.h"
+#include "audio_dsp.h"
 #include <esp_log.h>
 #include <cstring>
+#include <esp_memory_utils.h>
+#include <algorithm>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -17,8 +20,34 @@
 
 #define TAG "AudioService"
 
+// Only the dual-core targets offer the core affinity options
+#ifndef CONFIG_OPUS_ENCODER_TASK_CORE
+#define CONFIG_OPUS_ENCODER_TASK_CORE -1
+#endif
+#ifndef CONFIG_OPUS_DECODER_TASK_CORE
+#define CONFIG_OPUS_DECODER_TASK_CORE -1
+#endif
+// Without the adaptive complexity the encoder stays at 0
+#ifndef CONFIG_OPUS_ENCODER_MAX_COMPLEXITY
+#define CONFIG_OPUS_ENCODER_MAX_COMPLEXITY 0
+#endif
+
 
-AudioService::AudioService() {
+AudioService::AudioService()
+    // The decode queue also holds the audio testing recording when it is played back
+    : audio_decode_queue_(MAX_DECODE_PACKETS_IN_QUEUE + MAX_TESTING_PACKETS_IN_QUEUE, &decoder_event_, &decode_writable_event_),
+      audio_send_queue_(SEND_QUEUE_SLOTS, MAX_SEND_QUEUE_DURATION_MS, AUDIO_SEND_QUEUE_POLICY, &encoder_event_),
+      audio_encode_queue_(MAX_ENCODE_TASKS_IN_QUEUE, &encoder_event_, &encode_writable_event_),
+      audio_playback_queue_(MAX_PLAYBACK_TASKS_IN_QUEUE, &playback_event_, &decoder_event_),
+      audio_task_pool_("Task", [](AudioTask& task) {
+          task.timestamp = 0;
+          task.stage_time_us = 0;
+          task.pcm.clear();
+      }),
+      encoder_controller_(0, CONFIG_OPUS_ENCODER_MAX_COMPLEXITY),
+      cached_sounds_(AUDIO_MIXER_MAX_VOICES, &playback_event_, nullptr),
+      sound_queue_(MAX_SOUNDS_IN_QUEUE, &decoder_event_, nullptr),
+      sound_playback_queue_(MAX_SOUND_TASKS_IN_QUEUE, &playback_event_, &decoder_event_) {
     event_group_ = xEventGroupCreate();
 }
 
@@ -34,9 +63,25 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_->Start();
 
     /* Setup the audio codec */
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
+    decoder_cache_.Configure(codec->output_sample_rate());
+    decoder_ = &decoder_cache_.Get(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    sound_decoder_cache_.Configure(codec->output_sample_rate());
     opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    opus_encoder_->SetComplexity(encoder_controller_.complexity());
+    playback_clock_.SetSampleRate(codec->output_sample_rate());
+    time_stretcher_.Configure(codec->output_sample_rate());
+#if CONFIG_USE_ECHO_DELAY_ESTIMATION
+    echo_delay_estimator_.Configure(16000);
+#endif
+
+    /* Preallocate the queued items, steady-state streaming recycles them instead of using the heap */
+    audio_task_pool_.Reserve(MAX_ENCODE_TASKS_IN_QUEUE + MAX_PLAYBACK_TASKS_IN_QUEUE + MAX_SOUND_TASKS_IN_QUEUE +
+        AUDIO_POOL_SPARE_ITEMS);
+    ReservePackets(OPUS_FRAME_DURATION_MS);
+
+#if CONFIG_USE_SOUND_PCM_CACHE
+    sound_pcm_cache_ = std::make_unique<SoundPcmCache>(CONFIG_SOUND_PCM_CACHE_BUDGET_KB * 1024);
+#endif
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
@@ -75,7 +120,8 @@ void AudioService::Initialize(AudioCodec* codec) {
 
 void AudioService::Start() {
     service_stopped_ = false;
-    xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+    xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING |
+        AS_EVENT_BARGE_IN_RUNNING);
 
     esp_timer_start_periodic(audio_power_timer_, 1000000);
 
@@ -109,12 +155,20 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
 #endif
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus encoder and decoder tasks, pinned on dual-core targets if configured */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusEncoderTask();
+        vTaskDelete(NULL);
+    }, "opus_encoder", 2048 * 13, this, OPUS_ENCODER_TASK_PRIORITY, &opus_encoder_task_handle_,
+        CONFIG_OPUS_ENCODER_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_OPUS_ENCODER_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusDecoderTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_decoder", 2048 * 8, this, OPUS_DECODER_TASK_PRIORITY, &opus_decoder_task_handle_,
+        CONFIG_OPUS_DECODER_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_OPUS_DECODER_TASK_CORE);
 }
 
 void AudioService::Stop() {
@@ -124,57 +178,78 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    decoder_reset_pending_ = true;
+    cached_sounds_.Clear();
+    sound_queue_.Clear();
+    sound_playback_queue_.Clear();
+    mixer_reset_pending_ = true;
+    {
+        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+        audio_testing_queue_.clear();
+    }
+    encoder_event_.Notify();
+    decoder_event_.Notify();
+    encode_writable_event_.Notify();
+    decode_writable_event_.Notify();
+    playback_event_.Notify();
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
     if (!codec_->input_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableInput(true);
+        EnableInputPower();
     }
 
+    int64_t read_start_us = esp_timer_get_time();
+    int channels = codec_->input_channels();
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        /* Capture into the scratch buffer, the resamplers write the result */
+        auto& raw = capture_buffer_;
+        raw.resize(samples * codec_->input_sample_rate() / sample_rate * channels);
+        if (!codec_->InputData(raw)) {
             return false;
         }
-        if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
+        if (channels == 2) {
+            size_t frames = raw.size() / 2;
+            capture_planar_buffer_.resize(raw.size());
+            int16_t* mic = capture_planar_buffer_.data();
+            int16_t* reference = mic + frames;
+            AudioDeinterleave(raw.data(), frames, mic, reference);
+
+            /* The raw capture is consumed, reuse it for the resampled channels */
+            size_t resampled_frames = input_resampler_.GetOutputSamples(frames);
+            raw.resize(resampled_frames * 2);
+            input_resampler_.Process(mic, frames, raw.data());
+            reference_resampler_.Process(reference, frames, raw.data() + resampled_frames);
+            data.resize(resampled_frames * 2);
+            AudioInterleave(raw.data(), raw.data() + resampled_frames, resampled_frames, data.data());
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            data.resize(input_resampler_.GetOutputSamples(raw.size()));
+            input_resampler_.Process(raw.data(), raw.size(), data.data());
         }
     } else {
-        data.resize(samples * codec_->input_channels());
+        data.resize(samples * channels);
         if (!codec_->InputData(data)) {
             return false;
         }
     }
 
+#if CONFIG_USE_ECHO_DELAY_ESTIMATION
+    /* Delay the reference to the echo before the AEC and the barge-in detector compare them */
+    if (codec_->input_reference() && sample_rate == echo_delay_estimator_.sample_rate()) {
+        echo_delay_estimator_.Process(data.data(), data.size() / channels, channels);
+    }
+#endif
+
+    level_meter_.Measure(kAudioLevelInput, data.data(), data.size() / channels, channels);
+
     /* Update the last input time */
     last_input_time_ = std::chrono::steady_clock::now();
     debug_statistics_.input_count++;
+    AudioLatencyStats::GetInstance().RecordSince(kAudioLatencyI2sRead, read_start_us);
+    last_capture_time_us_ = esp_timer_get_time();
 
 #if CONFIG_USE_AUDIO_DEBUGGER
     // 音频调试：发送原始音频数据
@@ -188,37 +263,29 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    /* Reused for every frame, it keeps its capacity once it has grown to the feed size */
+    std::vector<int16_t> data;
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
-            AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
+            AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_BARGE_IN_RUNNING,
             pdFALSE, pdFALSE, portMAX_DELAY);
 
         if (service_stopped_) {
             break;
         }
-        if (audio_input_need_warmup_) {
-            audio_input_need_warmup_ = false;
-            vTaskDelay(pdMS_TO_TICKS(120));
-            continue;
-        }
-
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.size() >= MAX_TESTING_PACKETS_IN_QUEUE) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
             int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    AudioTakeLeftChannel(data.data(), data.size() / 2, data.data());
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -227,10 +294,12 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    if (bits & AS_EVENT_BARGE_IN_RUNNING) {
+                        FeedBargeInDetector(data);
+                    }
                     wake_word_->Feed(data);
                     continue;
                 }
@@ -239,16 +308,29 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    if (input_warmup_pending_ && DiscardInputWarmup(samples)) {
+                        continue;
+                    }
+                    if (bits & AS_EVENT_BARGE_IN_RUNNING) {
+                        FeedBargeInDetector(data);
+                    }
                     audio_processor_->Feed(std::move(data));
                     continue;
                 }
             }
         }
 
+        /* Nothing else reads the input while speaking, read it for the barge-in detector alone */
+        if (bits & AS_EVENT_BARGE_IN_RUNNING) {
+            if (ReadAudioData(data, 16000, BARGE_IN_FRAME_MS * 16000 / 1000)) {
+                FeedBargeInDetector(data);
+                continue;
+            }
+        }
+
         ESP_LOGE(TAG, "Should not be here, bits: %lx", bits);
         break;
     }
@@ -257,180 +339,520 @@ void AudioService::AudioInputTask() {
 }
 
 void AudioService::AudioOutputTask() {
+    /* Frames of silence the sounds are mixed into while the stream has nothing to play */
+    const size_t mixer_frame_samples = codec_->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000;
+
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        playback_event_.Wait([this]() {
+            return mixer_.HasVoices() || cached_sounds_.readable() || sound_playback_queue_.readable() ||
+                audio_playback_queue_.readable() || service_stopped_;
+        });
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        if (mixer_reset_pending_.exchange(false)) {
+            mixer_.Reset();
+            mixer_active_ = false;
+        }
+        const SoundPcmCache::Entry* requested;
+        while (cached_sounds_.Pop(requested)) {
+            mixer_.AddVoice(requested->pcm, requested->samples);
+        }
+        // The sound being decoded, a frame ahead of the mix so it plays on without a gap
+        AudioTaskPtr sound_frame;
+        while (mixer_.fed_samples() < mixer_frame_samples && sound_playback_queue_.Pop(sound_frame)) {
+            mixer_.Feed(sound_frame->pcm.data(), sound_frame->pcm.size());
+        }
+
+        /* The stream plays as it comes, the sounds are mixed over it instead of waiting for it */
+        AudioTaskPtr task;
+        std::vector<int16_t>* pcm;
+        if (audio_playback_queue_.Pop(task)) {
+            /* A frame decoded as the barge-in flushed the queues */
+            if (barge_in_detected_) {
+                continue;
+            }
+            pcm = &task->pcm;
+        } else if (mixer_.HasVoices()) {
+            mixer_buffer_.assign(mixer_frame_samples, 0);
+            pcm = &mixer_buffer_;
+        } else {
+            continue;
+        }
+        mixer_.Mix(pcm->data(), pcm->size());
+        mixer_active_ = mixer_.HasVoices();
+        /* One pass over the frame serves the level subscribers and the barge-in detector */
+        uint32_t playback_energy = level_meter_.Measure(kAudioLevelOutput, pcm->data(), pcm->size());
+        if ((xEventGroupGetBits(event_group_) & AS_EVENT_BARGE_IN_RUNNING) && !codec_->input_reference()) {
+            playback_energy_ = playback_energy;
+        }
 
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
-        codec_->OutputData(task->pcm);
+#if CONFIG_USE_SERVER_AEC
+        /* Register the frame before writing it, the DMA may start playing it before the write returns */
+        if (task && task->timestamp > 0) {
+            playback_clock_.AddFrame(codec_->output_written_frames(), pcm->size(), task->timestamp);
+        }
+#endif
+        codec_->OutputData(*pcm);
+        if (task) {
+            AudioLatencyStats::GetInstance().RecordSince(kAudioLatencyOutput, task->stage_time_us);
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
-
-#if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
-        }
-#endif
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
+void AudioService::OpusEncoderTask() {
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
+        encoder_event_.Wait([this]() {
+            return service_stopped_ || silence_suppression_active_ != silence_suppression_enabled_ ||
+                (audio_encode_queue_.readable() && IsSendQueueWritable());
         });
         if (service_stopped_) {
             break;
         }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
-
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
-            }
-            debug_statistics_.decode_count++;
+        /* Follow the silence suppression switch, DTX shrinks the keepalive frames to a few bytes */
+        if (silence_suppression_active_ != silence_suppression_enabled_) {
+            silence_suppression_active_ = silence_suppression_enabled_;
+            opus_encoder_->SetDtx(silence_suppression_active_);
+            last_voice_time_us_ = esp_timer_get_time();
+            ReleaseSilencePreroll();
         }
-        
+
         /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
+        AudioTaskPtr task;
+        if (IsSendQueueWritable() && audio_encode_queue_.Pop(task)) {
+            /* The frame size tells the duration: audio testing uses the default, the processor the negotiated one */
+            int frame_duration = task->pcm.size() * 1000 / 16000;
+            if (frame_duration != opus_encoder_->duration_ms()) {
+                ESP_LOGI(TAG, "Encoding %d ms frames", frame_duration);
+                opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+                opus_encoder_->SetComplexity(encoder_controller_.complexity());
+                opus_encoder_->SetDtx(silence_suppression_active_);
+            }
+
+            auto packet = AudioPacketPool::GetInstance().Acquire();
+            packet->frame_duration = frame_duration;
             packet->sample_rate = 16000;
             packet->timestamp = task->timestamp;
+            int64_t encode_start_us = esp_timer_get_time();
             if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
                 ESP_LOGE(TAG, "Failed to encode audio");
                 continue;
             }
-
             if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
-                }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
+                int64_t now = esp_timer_get_time();
+                int send_queue_ms = audio_send_queue_.duration_ms();
+                if (encoder_controller_.Update(now, now - encode_start_us, frame_duration, send_queue_ms, send_failures_)) {
+                    opus_encoder_->SetComplexity(encoder_controller_.complexity());
                 }
+            }
+            AudioLatencyStats::GetInstance().RecordSince(kAudioLatencyEncode, task->stage_time_us);
+            packet->stage_time_us = esp_timer_get_time();
+
+            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+                SendEncodedPacket(std::move(packet));
             } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
                 std::lock_guard<std::mutex> lock(audio_queue_mutex_);
                 audio_testing_queue_.push_back(std::move(packet));
             }
             debug_statistics_.encode_count++;
-            lock.lock();
         }
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    ESP_LOGW(TAG, "Opus encoder task stopped");
+}
+
+void AudioService::OpusDecoderTask() {
+    auto ready = [this]() {
+        // The speaker has nothing queued, a missing frame has to be concealed now
+        bool deadline = audio_playback_queue_.empty();
+        return service_stopped_ || decoder_reset_pending_ ||
+            (audio_decode_queue_.readable() && !jitter_buffer_.full()) ||
+            (!audio_playback_queue_.full() && jitter_buffer_.IsReady(deadline)) ||
+            (!sound_playback_queue_.full() && (decoding_sound_ || sound_queue_.readable())) ||
+            (sound_pcm_cache_ && sound_pcm_cache_->HasPending() && IsDecoderIdle());
+    };
+
+    while (true) {
+        /* The jitter buffer may become ready by itself while it is buffering */
+        int wait_ms = jitter_buffer_.GetWaitTimeMs();
+        if (wait_ms < 0) {
+            decoder_event_.Wait(ready);
+        } else {
+            decoder_event_.WaitFor(wait_ms, ready);
+        }
+        if (service_stopped_) {
+            break;
+        }
+
+        if (decoder_reset_pending_.exchange(false)) {
+            decoder_cache_.ResetState();
+            jitter_buffer_.Reset();
+            time_stretcher_.Reset();
+            time_stretch_flush_.clear();
+            decoding_sound_.reset();
+            sound_decoding_ = false;
+        }
+
+        /* Move the decode queue into the jitter buffer, which puts the packets back in order */
+        AudioStreamPacketPtr packet;
+        while (!jitter_buffer_.full() && audio_decode_queue_.Pop(packet)) {
+            jitter_buffer_.Insert(std::move(packet));
+        }
+
+        /* Decode the next frame from the jitter buffer */
+        if (!audio_playback_queue_.full() && (packet = jitter_buffer_.PopFrame(audio_playback_queue_.empty()))) {
+            auto task = audio_task_pool_.Acquire();
+            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+            task->timestamp = packet->timestamp;
+
+            // An empty payload is a lost frame, the decoder runs packet loss concealment
+            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+            if (decoder_->decoder->Decode(std::move(packet->payload), task->pcm)) {
+#if CONFIG_USE_AUDIO_CATCH_UP
+                // Stretch at the decoder rate, before resampling, the search is cheaper there
+                UpdateCatchUpSpeed(packet->frame_duration);
+                time_stretch_buffer_.clear();
+                time_stretcher_.Process(task->pcm.data(), task->pcm.size(), time_stretch_buffer_);
+                task->pcm.swap(time_stretch_buffer_);
+#endif
+                // Resample if the sample rate is different
+                if (decoder_->resampling()) {
+                    int target_size = decoder_->resampler.GetOutputSamples(task->pcm.size());
+                    output_resample_buffer_.resize(target_size);
+                    decoder_->resampler.Process(task->pcm.data(), task->pcm.size(), output_resample_buffer_.data());
+                    task->pcm.swap(output_resample_buffer_);
+                }
+#if CONFIG_USE_AUDIO_CATCH_UP
+                if (!time_stretch_flush_.empty()) {
+                    task->pcm.insert(task->pcm.begin(), time_stretch_flush_.begin(), time_stretch_flush_.end());
+                    time_stretch_flush_.clear();
+                }
+#endif
+                // Local sounds and concealed frames carry no receive time and are not counted
+                AudioLatencyStats::GetInstance().RecordSince(kAudioLatencyDecode, packet->stage_time_us);
+                task->stage_time_us = esp_timer_get_time();
+
+                // We are the only producer and checked for room above, so this cannot fail
+                audio_playback_queue_.TryPush(std::move(task));
+            } else {
+                ESP_LOGE(TAG, "Failed to decode audio");
+            }
+            debug_statistics_.decode_count++;
+        }
+
+        /* The sound next to the stream, a frame at a time so neither waits for the other */
+        if (!sound_playback_queue_.full() && (decoding_sound_ || sound_queue_.readable())) {
+            DecodeSoundFrame();
+        }
+
+        /* Decode the registered UI sounds while no audio is waiting */
+        if (sound_pcm_cache_ && sound_pcm_cache_->HasPending() && IsDecoderIdle()) {
+            sound_pcm_cache_->Fill(codec_->output_sample_rate());
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus decoder task stopped");
+}
+
+void AudioService::DecodeSoundFrame() {
+    if (!decoding_sound_) {
+        // Set first, IsIdle() must not see the sound in neither place
+        sound_decoding_ = true;
+        if (!sound_queue_.Pop(decoding_sound_)) {
+            sound_decoding_ = false;
+            return;
+        }
+        decoding_sound_packet_ = 0;
+        sound_decoder_cache_.ResetState();
+    }
+
+    const OggPacketIndex& index = *decoding_sound_->index;
+    if (decoding_sound_packet_ < index.packets.size()) {
+        const auto& item = index.packets[decoding_sound_packet_++];
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(decoding_sound_->ogg.data()) + item.offset;
+        auto& decoder = sound_decoder_cache_.Get(index.sample_rate, OPUS_FRAME_DURATION_MS);
+        auto task = audio_task_pool_.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        // The decoder takes an owning buffer, this one keeps its capacity from sound to sound
+        sound_payload_.assign(data, data + item.size);
+        if (decoder.decoder->Decode(std::move(sound_payload_), task->pcm)) {
+            if (decoder.resampling()) {
+                output_resample_buffer_.resize(decoder.resampler.GetOutputSamples(task->pcm.size()));
+                decoder.resampler.Process(task->pcm.data(), task->pcm.size(), output_resample_buffer_.data());
+                task->pcm.swap(output_resample_buffer_);
+            }
+            // The only producer, the caller checked for room
+            sound_playback_queue_.TryPush(std::move(task));
+        } else {
+            ESP_LOGE(TAG, "Failed to decode sound");
+        }
+    }
+    if (decoding_sound_packet_ >= index.packets.size()) {
+        decoding_sound_.reset();
+        sound_decoding_ = false;
+    }
+}
+
+void AudioService::SendEncodedPacket(AudioStreamPacketPtr packet) {
+    /* The hangover keeps the end of the speech with it, for the suppression and for the send queue drops */
+    int64_t now = esp_timer_get_time();
+    if (voice_detected_) {
+        last_voice_time_us_ = now;
+    }
+    bool silent = now - last_voice_time_us_ >= UPLINK_SILENCE_HANGOVER_MS * 1000;
+
+    if (silence_suppression_active_) {
+        /*
+         * Every frame is encoded, so the encoder state and the server AEC timestamps stay in step;
+         * a suppressed frame is just not sent, the frames that are sent keep their own timestamps.
+         */
+        if (silent && now - last_uplink_send_time_us_ < UPLINK_SILENCE_KEEPALIVE_MS * 1000) {
+            uplink_suppressed_frames_++;
+            uplink_suppressed_bytes_ += packet->payload.size();
+            KeepSilencePreroll(std::move(packet));
+            return;
+        }
+        if (!silent) {
+            SendSilencePreroll(packet->frame_duration);
+        }
+        ReleaseSilencePreroll();
+        last_uplink_send_time_us_ = now;
+    }
+
+    // A frame the send queue drops at once (full ring, or the bound under the block policy) is not sent
+    if (audio_send_queue_.Push(std::move(packet), !silent)) {
+        uplink_sent_frames_++;
+    }
+    if (callbacks_.on_send_queue_available) {
+        callbacks_.on_send_queue_available();
+    }
+}
+
+void AudioService::KeepSilencePreroll(AudioStreamPacketPtr packet) {
+    /* Only the newest UPLINK_SILENCE_PREROLL_MS are kept, the older frames go back to the pool */
+    while (silence_preroll_count_ > 0 && (silence_preroll_count_ == silence_preroll_.size() ||
+        silence_preroll_ms_ + packet->frame_duration > UPLINK_SILENCE_PREROLL_MS)) {
+        auto& oldest = silence_preroll_[silence_preroll_first_];
+        silence_preroll_ms_ -= oldest->frame_duration;
+        oldest.reset();
+        silence_preroll_first_ = (silence_preroll_first_ + 1) % silence_preroll_.size();
+        silence_preroll_count_--;
+    }
+    silence_preroll_ms_ += packet->frame_duration;
+    silence_preroll_[(silence_preroll_first_ + silence_preroll_count_) % silence_preroll_.size()] = std::move(packet);
+    silence_preroll_count_++;
+}
+
+void AudioService::SendSilencePreroll(int next_frame_ms) {
+    /* Oldest first, they are no longer suppressed */
+    const bool block = audio_send_queue_.policy() == kAudioSendQueueBlock;
+    for (; silence_preroll_count_ > 0; silence_preroll_count_--) {
+        auto& packet = silence_preroll_[silence_preroll_first_];
+        silence_preroll_first_ = (silence_preroll_first_ + 1) % silence_preroll_.size();
+        const int remaining_ms = silence_preroll_ms_;
+        silence_preroll_ms_ -= packet->frame_duration;
+        // The bound has to take this frame, the newer ones and the speech after them, or the oldest stays suppressed
+        if (block && !audio_send_queue_.HasRoom(remaining_ms + next_frame_ms)) {
+            packet.reset();
+            continue;
+        }
+        uplink_suppressed_frames_--;
+        uplink_suppressed_bytes_ -= packet->payload.size();
+        if (audio_send_queue_.Push(std::move(packet), false)) {
+            uplink_sent_frames_++;
+        }
+    }
+}
+
+void AudioService::ReleaseSilencePreroll() {
+    for (auto& packet : silence_preroll_) {
+        packet.reset();
+    }
+    silence_preroll_first_ = 0;
+    silence_preroll_count_ = 0;
+    silence_preroll_ms_ = 0;
+}
+
+bool AudioService::IsSendQueueWritable() {
+    // Called by the opus encoder task only, the queue producer; under the drop policies congestion drops old audio instead
+    return audio_send_queue_.policy() != kAudioSendQueueBlock || audio_send_queue_.HasRoom(opus_encoder_->duration_ms());
+}
+
+void AudioService::SetEncodeFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms, keeping %d ms", frame_duration_ms, encode_frame_duration_.load());
+        return;
+    }
+    if (encode_frame_duration_.exchange(frame_duration_ms) != frame_duration_ms) {
+        ESP_LOGI(TAG, "Uplink frame duration set to %d ms", frame_duration_ms);
+        ReservePackets(frame_duration_ms);
+    }
+}
+
+void AudioService::ReservePackets(int uplink_frame_duration_ms) {
+    /*
+     * Full queues at the frame durations in use: the uplink one once it is negotiated, the pool
+     * only grows, and the downlink at 60 ms; shorter downlink frames take the rest from the heap.
+     */
+    AudioPacketPool::GetInstance().Reserve(MAX_DECODE_QUEUE_DURATION_MS / OPUS_FRAME_DURATION_MS +
+        JITTER_BUFFER_CAPACITY + MAX_SEND_QUEUE_DURATION_MS / uplink_frame_duration_ms +
+        UPLINK_SILENCE_PREROLL_MS / uplink_frame_duration_ms + AUDIO_POOL_SPARE_ITEMS);
+}
+
+void AudioService::SetEncoderPriorityBoost(bool enable) {
+#if CONFIG_OPUS_ENCODER_PRIORITY_BOOST
+    if (service_stopped_ || opus_encoder_task_handle_ == nullptr) {
+        return;
+    }
+    vTaskPrioritySet(opus_encoder_task_handle_, enable ? OPUS_ENCODER_TASK_BOOSTED_PRIORITY : OPUS_ENCODER_TASK_PRIORITY);
+#endif
+}
+
+void AudioService::EnableSilenceSuppression(bool enable) {
+#if CONFIG_USE_UPLINK_SILENCE_SUPPRESSION
+    if (silence_suppression_enabled_.exchange(enable) == enable) {
+        return;
+    }
+    ESP_LOGI(TAG, "%s uplink silence suppression", enable ? "Enabling" : "Disabling");
+    // The encoder task follows the switch at once, and gives the frames it kept back to the pool
+    encoder_event_.Notify();
+    if (!enable) {
+        auto stats = GetUplinkSilenceStats();
+        ESP_LOGI(TAG, "Uplink frames sent: %lu, suppressed: %lu (%lu bytes)",
+            stats.sent_frames, stats.suppressed_frames, stats.suppressed_bytes);
+    }
+#endif
+}
+
+UplinkSilenceStats AudioService::GetUplinkSilenceStats() const {
+    UplinkSilenceStats stats;
+    stats.sent_frames = uplink_sent_frames_;
+    stats.suppressed_frames = uplink_suppressed_frames_;
+    stats.suppressed_bytes = uplink_suppressed_bytes_;
+    return stats;
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+    if (decoder_->decoder->sample_rate() == sample_rate && decoder_->decoder->duration_ms() == frame_duration) {
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+#if CONFIG_USE_AUDIO_CATCH_UP
+    if (time_stretcher_.sample_rate() != sample_rate) {
+        /* Configure() drops the input held back, it plays at 1.0x through the old resampler ahead of the next frame */
+        int speed = time_stretcher_.speed();
+        time_stretcher_.SetSpeed(1000);
+        time_stretch_buffer_.clear();
+        time_stretcher_.Process(nullptr, 0, time_stretch_buffer_);
+        time_stretcher_.SetSpeed(speed);
+        if (decoder_->resampling() && !time_stretch_buffer_.empty()) {
+            size_t offset = time_stretch_flush_.size();
+            time_stretch_flush_.resize(offset + decoder_->resampler.GetOutputSamples(time_stretch_buffer_.size()));
+            decoder_->resampler.Process(time_stretch_buffer_.data(), time_stretch_buffer_.size(),
+                time_stretch_flush_.data() + offset);
+        } else {
+            time_stretch_flush_.insert(time_stretch_flush_.end(), time_stretch_buffer_.begin(), time_stretch_buffer_.end());
+        }
+    }
+#endif
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    // The decoder of the other stream keeps its state, and its resampler the filter history
+    decoder_ = &decoder_cache_.Get(sample_rate, frame_duration);
+    if (time_stretcher_.sample_rate() != sample_rate) {
+        time_stretcher_.Configure(sample_rate);
+    }
+}
+
+void AudioService::UpdateCatchUpSpeed(int frame_duration) {
+#if CONFIG_USE_AUDIO_CATCH_UP
+    /*
+     * Above the latency bound play at the maximum speed, and slow down as the backlog drains
+     * until half of the bound is left, so a long stall is caught up without a sudden change.
+     */
+    const int bound = CONFIG_AUDIO_CATCH_UP_MAX_LATENCY_MS;
+    const int boost = CONFIG_AUDIO_CATCH_UP_MAX_SPEED - 1000;
+    int backlog_ms = (int)(audio_decode_queue_.size() + jitter_buffer_.depth() + audio_playback_queue_.size()) * frame_duration;
+    int speed = 1000;
+    if (backlog_ms > bound || (time_stretcher_.speed() > 1000 && backlog_ms > bound / 2)) {
+        speed = 1000 + std::min(boost, (backlog_ms - bound / 2) * boost / (bound / 2));
+    }
+    if ((speed > 1000) != (time_stretcher_.speed() > 1000)) {
+        ESP_LOGI(TAG, "Catch-up playback %s, %d ms buffered", speed > 1000 ? "started" : "stopped", backlog_ms);
     }
+    time_stretcher_.SetSpeed(speed);
+#endif
 }
 
 void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+    auto task = audio_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
+    // Copy into the recycled buffer, taking over the caller's vector would drop its capacity
+    task->pcm.assign(pcm.begin(), pcm.end());
+    task->stage_time_us = esp_timer_get_time();
     
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
-        }
-        timestamp_queue_.pop_front();
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        int64_t capture_time_us = last_capture_time_us_;
+        AudioLatencyStats::GetInstance().RecordSince(kAudioLatencyProcessor, capture_time_us);
+#if CONFIG_USE_SERVER_AEC
+        /* The stream time that was leaving the DAC when the first sample of the frame was captured */
+        int64_t first_sample_us = capture_time_us - (int64_t)task->pcm.size() * 1000000 / 16000;
+        task->timestamp = playback_clock_.GetTimestamp(codec_->GetOutputPosition(first_sample_us));
+#endif
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue, the processor output and audio testing never run at the same time */
+    encode_writable_event_.Wait([this]() { return !audio_encode_queue_.full() || service_stopped_; });
+    audio_encode_queue_.TryPush(std::move(task));
 }
 
-bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+bool AudioService::PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait) {
+    int frame_duration = packet->frame_duration > 0 ? packet->frame_duration : OPUS_FRAME_DURATION_MS;
+    auto has_room = [this, frame_duration]() {
+        return audio_decode_queue_.size() * frame_duration < MAX_DECODE_QUEUE_DURATION_MS && !audio_decode_queue_.full();
+    };
+    /* The user talked over the playback, the rest of the response is not played */
+    if (!wait && barge_in_detected_) {
+        return false;
+    }
+    /* Kept for the jitter estimate, the decoder task owns the packet once it is queued */
+    const uint32_t sequence = packet->sequence;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(decode_push_mutex_);
+            if (has_room() && audio_decode_queue_.TryPush(std::move(packet))) {
+                if (!wait) {
+                    // Only the network pushes without waiting, local sounds would skew the jitter estimate
+                    jitter_buffer_.OnPacketArrival(sequence, frame_duration);
+                }
+                return true;
+            }
+        }
+        if (!wait || service_stopped_) {
             return false;
         }
+        decode_writable_event_.Wait([this, &has_room]() { return service_stopped_ || has_room(); });
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+AudioStreamPacketPtr AudioService::PopPacketFromSendQueue() {
+    AudioStreamPacketPtr packet;
+    if (audio_send_queue_.Pop(packet)) {
+        AudioLatencyStats::GetInstance().RecordSince(kAudioLatencySendQueue, packet->stage_time_us);
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
@@ -444,8 +866,8 @@ const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
+AudioStreamPacketPtr AudioService::PopWakeWordPacket() {
+    auto packet = AudioPacketPool::GetInstance().Acquire();
     if (wake_word_->GetWakeWordOpus(packet->payload)) {
         return packet;
     }
@@ -482,14 +904,18 @@ void AudioService::EnableVoiceProcessing(bool enable) {
             audio_processor_initialized_ = true;
         }
 
+        /* Follow the uplink frame duration negotiated for this channel */
+        audio_processor_->SetFrameDuration(encode_frame_duration_);
+
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        input_warmup_pending_ = true;
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        input_warm_until_us_ = esp_timer_get_time() + AUDIO_INPUT_WARM_HOLD_MS * 1000LL;
     }
 }
 
@@ -499,10 +925,17 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
+        /* Move audio_testing_queue_ to audio_decode_queue_ */
         std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        std::lock_guard<std::mutex> push_lock(decode_push_mutex_);
+        audio_decode_queue_.Clear();
+        for (auto& packet : audio_testing_queue_) {
+            if (!audio_decode_queue_.TryPush(std::move(packet))) {
+                ESP_LOGW(TAG, "Decode queue is full, dropping the rest of the audio testing data");
+                break;
+            }
+        }
+        audio_testing_queue_.clear();
     }
 }
 
@@ -514,6 +947,44 @@ void AudioService::EnableDeviceAec(bool enable) {
     }
 
     audio_processor_->EnableDeviceAec(enable);
+    device_aec_enabled_ = enable;
+}
+
+void AudioService::EnableBargeInDetection(bool enable) {
+    ESP_LOGD(TAG, "%s barge-in detection", enable ? "Enabling" : "Disabling");
+    barge_in_detected_ = false;
+    if (enable) {
+        playback_energy_ = 0;
+        barge_in_start_pending_ = true;
+        xEventGroupSetBits(event_group_, AS_EVENT_BARGE_IN_RUNNING);
+    } else {
+        xEventGroupClearBits(event_group_, AS_EVENT_BARGE_IN_RUNNING);
+    }
+}
+
+void AudioService::FeedBargeInDetector(const std::vector<int16_t>& data) {
+    if (barge_in_start_pending_.exchange(false)) {
+        /* The VAD only tells the user from the echo when the device cancels it */
+        bool vad = IsAudioProcessorRunning() && device_aec_enabled_;
+        barge_in_detector_.Start(vad ? kBargeInModeVad : kBargeInModeEnergy);
+    }
+
+    int channels = codec_->input_channels();
+    const int16_t* reference = codec_->input_reference() ? data.data() + 1 : nullptr;
+    /* Between the sentences nothing is played, the last frame does not count */
+    auto output_idle = std::chrono::steady_clock::now() - last_output_time_;
+    uint32_t playback_energy = output_idle < std::chrono::milliseconds(2 * OPUS_FRAME_DURATION_MS) ? playback_energy_.load() : 0;
+    if (!barge_in_detector_.Process(data.data(), reference, data.size() / channels, channels, playback_energy,
+            voice_detected_)) {
+        return;
+    }
+
+    /* Stop the playback here, the abort goes to the server in parallel */
+    barge_in_detected_ = true;
+    ResetDecoder();
+    if (callbacks_.on_barge_in) {
+        callbacks_.on_barge_in();
+    }
 }
 
 void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
@@ -527,118 +998,119 @@ void AudioService::PlaySound(const std::string_view& ogg) {
         codec_->EnableOutput(true);
     }
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
-
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
+    /* A cached sound is mixed in by the output task at once, over anything still being decoded */
+    if (sound_pcm_cache_) {
+        if (auto entry = sound_pcm_cache_->Find(ogg)) {
+            std::lock_guard<std::mutex> lock(sound_push_mutex_);
+            // With as many sounds waiting as the mixer has voices, this one is decoded instead
+            bool pushed = cached_sounds_.TryPush(std::move(entry));
+            sound_pcm_cache_->CountFound(pushed);
+            if (pushed) {
+                return;
+            }
         }
-        return static_cast<size_t>(-1);
-    };
+    }
 
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
+    /* Any other sound is decoded into the mixer by the opus decoder task, after the sounds before it */
+    auto sound = std::make_unique<SoundRequest>();
+    if (esp_ptr_in_drom(ogg.data())) {
+        sound->ogg = ogg;
+    } else {
+        sound->data.assign(ogg.data(), ogg.size());
+        sound->ogg = sound->data;
+    }
+    sound->index = &GetSoundIndex(sound->ogg, sound->uncached);
+    std::lock_guard<std::mutex> lock(sound_push_mutex_);
+    if (!sound_queue_.TryPush(std::move(sound))) {
+        ESP_LOGW(TAG, "Too many sounds queued, dropping one");
+    }
+}
 
-    while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                   version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
-            }
+const OggPacketIndex& AudioService::GetSoundIndex(const std::string_view& ogg, OggPacketIndex& uncached) {
+    /* Sounds embedded in flash never move, so their index is built once and kept */
+    if (!esp_ptr_in_drom(ogg.data())) {
+        uncached.Build(ogg);
+        return uncached;
+    }
 
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
-        }
+    std::lock_guard<std::mutex> lock(sound_index_mutex_);
+    auto it = sound_indexes_.find(ogg.data());
+    if (it == sound_indexes_.end() || it->second.size != ogg.size()) {
+        auto& entry = sound_indexes_[ogg.data()];
+        entry.size = ogg.size();
+        entry.index.Build(ogg);
+        ESP_LOGI(TAG, "Indexed sound %p: %u packets", ogg.data(), entry.index.packets.size());
+        return entry.index;
+    }
+    return it->second.index;
+}
+
+void AudioService::CacheSound(const std::string_view& ogg) {
+    /* Only sounds in flash keep their address, which is the cache key */
+    if (!sound_pcm_cache_ || !esp_ptr_in_drom(ogg.data())) {
+        return;
+    }
+    sound_pcm_cache_->Register(ogg);
+    decoder_event_.Notify();
+}
 
-        offset = body_off + body_size;
+AudioProcessorStats AudioService::GetAudioProcessorStats() {
+    if (audio_processor_ == nullptr) {
+        return AudioProcessorStats();
     }
+    return audio_processor_->GetStats();
+}
+
+SoundPcmCacheStats AudioService::GetSoundPcmCacheStats() {
+    if (!sound_pcm_cache_) {
+        return SoundPcmCacheStats();
+    }
+    return sound_pcm_cache_->GetStats();
+}
+
+bool AudioService::IsDecoderIdle() {
+    return audio_decode_queue_.empty() && jitter_buffer_.depth() == 0;
+}
+
+AudioQueueDepths AudioService::GetQueueDepths() const {
+    AudioQueueDepths depths;
+    depths.encode = audio_encode_queue_.size();
+    depths.send = audio_send_queue_.size();
+    depths.decode = audio_decode_queue_.size();
+    depths.jitter = jitter_buffer_.depth();
+    depths.playback = audio_playback_queue_.size();
+    return depths;
 }
 
 bool AudioService::IsIdle() {
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && jitter_buffer_.depth() == 0 &&
+        audio_playback_queue_.empty() && audio_testing_queue_.empty() && cached_sounds_.empty() && sound_queue_.empty() && !sound_decoding_ &&
+        sound_playback_queue_.empty() && !mixer_active_;
 }
 
 void AudioService::ResetDecoder() {
+    /* The decoder and the jitter buffer belong to the opus decoder task, it resets them before the next packet */
+    decoder_reset_pending_ = true;
+    decoder_event_.Notify();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    cached_sounds_.Clear();
+    sound_queue_.Clear();
+    sound_playback_queue_.Clear();
+    mixer_reset_pending_ = true;
+    playback_event_.Notify();
+    playback_clock_.Reset();
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
     audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
     auto now = std::chrono::steady_clock::now();
     auto input_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_input_time_).count();
     auto output_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_output_time_).count();
-    if (input_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->input_enabled()) {
+    bool input_held = esp_timer_get_time() < input_warm_until_us_;
+    if (input_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->input_enabled() && !input_held) {
         codec_->EnableInput(false);
     }
     if (output_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->output_enabled()) {
@@ -649,6 +1121,60 @@ void AudioService::CheckAndUpdateAudioPowerState() {
     }
 }
 
+void AudioService::EnableInputPower() {
+    esp_timer_stop(audio_power_timer_);
+    esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+    codec_->EnableInput(true);
+    input_enabled_time_us_ = esp_timer_get_time();
+}
+
+void AudioService::PrepareInput() {
+    if (!codec_->input_enabled()) {
+        ESP_LOGI(TAG, "Powering the input ahead of voice processing");
+        EnableInputPower();
+    }
+    /* Nothing reads the input until voice processing starts, keep the power timer off it meanwhile */
+    input_warm_until_us_ = esp_timer_get_time() + AUDIO_POWER_TIMEOUT_MS * 1000LL;
+}
+
+bool AudioService::DiscardInputWarmup(size_t samples) {
+    /* Counted in samples from the first read, only the settling time the ADC has not been powered for yet */
+    if (input_warmup_remaining_samples_ < 0) {
+        int64_t read_start_us = last_capture_time_us_ - (int64_t)samples * 1000000 / 16000;
+        int64_t powered_us = std::max<int64_t>(0, read_start_us - input_enabled_time_us_);
+        int64_t remaining_us = std::max<int64_t>(0, AUDIO_INPUT_WARMUP_MS * 1000LL - powered_us);
+        input_warmup_remaining_samples_ = remaining_us * 16000 / 1000000;
+    }
+    if (input_warmup_remaining_samples_ > 0) {
+        input_warmup_remaining_samples_ -= std::min<int32_t>(samples, input_warmup_remaining_samples_);
+        input_warmup_discarded_samples_ += samples;
+        return true;
+    }
+
+    input_warmup_pending_ = false;
+    input_warmup_remaining_samples_ = -1;
+    uint32_t discarded_ms = input_warmup_discarded_samples_ * 1000 / 16000;
+    uint32_t saved_ms = discarded_ms < AUDIO_INPUT_WARMUP_MS ? AUDIO_INPUT_WARMUP_MS - discarded_ms : 0;
+    input_warmup_discarded_samples_ = 0;
+    input_warmup_starts_++;
+    if (discarded_ms > 0) {
+        input_warmup_cold_starts_++;
+        input_warmup_discarded_ms_ += discarded_ms;
+    }
+    input_warmup_saved_ms_ += saved_ms;
+    ESP_LOGI(TAG, "Input ready, discarded %lu ms of warm-up, saved %lu ms", (unsigned long)discarded_ms, (unsigned long)saved_ms);
+    return false;
+}
+
+AudioInputWarmupStats AudioService::GetInputWarmupStats() const {
+    AudioInputWarmupStats stats;
+    stats.starts = input_warmup_starts_;
+    stats.cold_starts = input_warmup_cold_starts_;
+    stats.discarded_ms = input_warmup_discarded_ms_;
+    stats.saved_ms = input_warmup_saved_ms_;
+    return stats;
+}
+
 void AudioService::SetModelsList(srmodel_list_t* models_list) {
     models_list_ = models_list;
 
@@ -2,10 +2,12 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
+#include <array>
 #include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <map>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -15,10 +17,24 @@
 
 #include <opus_encoder.h>
 #include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "audio_codec.h"
+#include "audio_resampler.h"
 #include "audio_processor.h"
+#include "audio_queue.h"
+#include "audio_send_queue.h"
+#include "audio_jitter_buffer.h"
+#include "ogg_packet_index.h"
+#include "sound_pcm_cache.h"
+#include "audio_latency.h"
+#include "audio_mixer.h"
+#include "audio_playback_clock.h"
+#include "barge_in_detector.h"
+#include "audio_time_stretch.h"
+#include "audio_decoder_cache.h"
+#include "echo_delay_estimator.h"
+#include "audio_level_meter.h"
+#include "opus_encoder_controller.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
@@ -27,36 +43,92 @@
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * Sounds are mixed over the stream by the speaker task instead of queued behind it. Cached UI sounds
+ * skip the decoder; the others are decoded with a decoder of their own, one sound after the other:
+ * (PlaySound) -> {Sound Queue} -> [Opus Decoder] -> {Sound Playback Queue} -> [Mixer] -> (Speaker)
+ *
+ * We use one task for MIC / Speaker / Processors, and one task each for the Opus Encoder and the Opus Decoder,
+ * so a long decode never delays the uplink and the other way round.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
+ * Every queue is a bounded single-producer / single-consumer ring with its own wake-up events,
+ * so the tasks never contend on a shared lock while audio is flowing.
+ * 
  */
 
+// Default frame duration, used by the prompts, audio testing and until the uplink duration is negotiated
 #define OPUS_FRAME_DURATION_MS 60
+// The uplink can be negotiated down to this, the ring capacities (slots of one pointer) are sized for it
+#define OPUS_MIN_FRAME_DURATION_MS 20
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+// Sounds waiting for the decoder, the activation prompt and a six digit code fit
+#define MAX_SOUNDS_IN_QUEUE 8
+#define MAX_SOUND_TASKS_IN_QUEUE 2
+// The decode and send queues are limited by the audio they hold, not by the packet count
+#define MAX_DECODE_QUEUE_DURATION_MS 2400
+// The uplink bound and what happens past it, the options only exist in the project Kconfig
+#ifndef CONFIG_AUDIO_SEND_QUEUE_DURATION_MS
+#define CONFIG_AUDIO_SEND_QUEUE_DURATION_MS 2400
+#endif
+#if CONFIG_AUDIO_SEND_QUEUE_POLICY_DROP_OLDEST
+#define AUDIO_SEND_QUEUE_POLICY kAudioSendQueueDropOldest
+#elif CONFIG_AUDIO_SEND_QUEUE_POLICY_BLOCK
+#define AUDIO_SEND_QUEUE_POLICY kAudioSendQueueBlock
+#else
+#define AUDIO_SEND_QUEUE_POLICY kAudioSendQueueDropSilenceFirst
+#endif
+#define MAX_SEND_QUEUE_DURATION_MS CONFIG_AUDIO_SEND_QUEUE_DURATION_MS
+#define MAX_DECODE_PACKETS_IN_QUEUE (MAX_DECODE_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+#define MAX_SEND_PACKETS_IN_QUEUE (MAX_SEND_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+// The slots of the packets dropped while a send is stuck stay taken, empty, until the consumer
+// skips them; these cover about a second of 60 ms frames, the new frames past that are overflows
+#define SEND_QUEUE_DROPPED_SLOTS 16
+#define SEND_QUEUE_SLOTS (MAX_SEND_PACKETS_IN_QUEUE + SEND_QUEUE_DROPPED_SLOTS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
-#define MAX_TIMESTAMPS_IN_QUEUE 3
+#define MAX_TESTING_PACKETS_IN_QUEUE (AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS)
+// Spare pool entries for the items held by the tasks between two queues
+#define AUDIO_POOL_SPARE_ITEMS 4
+
+#define OPUS_ENCODER_TASK_PRIORITY 2
+#define OPUS_ENCODER_TASK_BOOSTED_PRIORITY 3
+#define OPUS_DECODER_TASK_PRIORITY 2
+
+// Uplink silence suppression: frames keep flowing this long after the VAD reports silence,
+// then only a keepalive frame is sent at this interval
+#define UPLINK_SILENCE_HANGOVER_MS 400
+#define UPLINK_SILENCE_KEEPALIVE_MS 1000
+// Suppressed audio kept and sent ahead of the speech: the AFE VAD reports speech after about
+// 128 ms of it, a feed chunk later
+#define UPLINK_SILENCE_PREROLL_MS 240
+#define UPLINK_SILENCE_PREROLL_PACKETS (UPLINK_SILENCE_PREROLL_MS / OPUS_MIN_FRAME_DURATION_MS)
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+// Settling time of the ADC after it is powered, the input read meanwhile is discarded
+#define AUDIO_INPUT_WARMUP_MS 120
+// The input stays powered this long after a conversation, a follow-up is likely
+#define AUDIO_INPUT_WARM_HOLD_MS 60000
+// Input block read for the barge-in detector when nothing else reads the input
+#define BARGE_IN_FRAME_MS 30
 
 
 #define AS_EVENT_AUDIO_TESTING_RUNNING      (1 << 0)
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_BARGE_IN_RUNNING           (1 << 4)
 
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
     std::function<void(bool)> on_vad_change;
     std::function<void(void)> on_audio_testing_queue_full;
+    // From the audio input task, the playback is already stopped
+    std::function<void(void)> on_barge_in;
 };
 
 
@@ -70,8 +142,11 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    int64_t stage_time_us;  // When the frame entered its pipeline stage, for the latency stats
 };
 
+using AudioTaskPtr = AudioPoolPtr<AudioTask>;
+
 struct DebugStatistics {
     uint32_t input_count = 0;
     uint32_t decode_count = 0;
@@ -79,6 +154,27 @@ struct DebugStatistics {
     uint32_t playback_count = 0;
 };
 
+struct UplinkSilenceStats {
+    uint32_t sent_frames = 0;
+    uint32_t suppressed_frames = 0;
+    uint32_t suppressed_bytes = 0;  // Opus payload not sent
+};
+
+struct AudioInputWarmupStats {
+    uint32_t starts = 0;            // Voice processing starts
+    uint32_t cold_starts = 0;       // ... that had to discard input while the ADC settled
+    uint32_t discarded_ms = 0;
+    uint32_t saved_ms = 0;          // Against the fixed AUDIO_INPUT_WARMUP_MS wait on every start
+};
+
+struct AudioQueueDepths {
+    uint32_t encode = 0;
+    uint32_t send = 0;
+    uint32_t decode = 0;
+    uint32_t jitter = 0;
+    uint32_t playback = 0;
+};
+
 class AudioService {
 public:
     AudioService();
@@ -88,10 +184,13 @@ public:
     void Start();
     void Stop();
     void EncodeWakeWord();
-    std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
+    AudioStreamPacketPtr PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
     bool IsIdle();
+    // Diagnostics snapshots, e.g. for the host replay harness; the counters are not synchronized
+    const DebugStatistics& GetDebugStatistics() const { return debug_statistics_; }
+    AudioQueueDepths GetQueueDepths() const;
     bool IsWakeWordRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_WAKE_WORD_RUNNING; }
     bool IsAudioProcessorRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING; }
     bool IsAfeWakeWord();
@@ -100,14 +199,50 @@ public:
     void EnableVoiceProcessing(bool enable);
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
+    // Listen for the user talking over the playback, while speaking
+    void EnableBargeInDetection(bool enable);
+    // Not synchronized with the audio input task
+    BargeInStats GetBargeInStats() const { return barge_in_detector_.GetStats(); }
+    // Catch-up playback, not synchronized with the opus decoder task
+    AudioTimeStretchStats GetTimeStretchStats() const { return time_stretcher_.GetStats(); }
+    // Not synchronized with the opus decoder task
+    AudioDecoderCacheStats GetDecoderCacheStats() const { return decoder_cache_.GetStats(); }
+    // Not synchronized with the audio input task
+    EchoDelayStats GetEchoDelayStats() const { return echo_delay_estimator_.GetStats(); }
+    // Input and output levels, for any task to read or subscribe to
+    AudioLevelMeter& GetLevelMeter() { return level_meter_; }
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
-    bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    bool PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait = false);
+    AudioStreamPacketPtr PopPacketFromSendQueue();
+    // Never waits for the playback: the sound is mixed over it, after the sounds played before
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    JitterBufferStats GetJitterBufferStats() const { return jitter_buffer_.GetStats(); }
+    // Keep the decoded PCM of a short sound in PSRAM, so PlaySound starts it without the decoder
+    void CacheSound(const std::string_view& sound);
+    SoundPcmCacheStats GetSoundPcmCacheStats();
+    // Uplink frame duration (20, 40 or 60 ms), takes effect the next time voice processing is enabled
+    void SetEncodeFrameDuration(int frame_duration_ms);
+    int GetEncodeFrameDuration() const { return encode_frame_duration_; }
+    // Run the encoder above the playback decoder, used while listening
+    void SetEncoderPriorityBoost(bool enable);
+    // Stop sending uplink frames while the VAD reports silence, except a periodic keepalive
+    void EnableSilenceSuppression(bool enable);
+    UplinkSilenceStats GetUplinkSilenceStats() const;
+    // Audio the uplink queue dropped under congestion, from any task
+    AudioSendQueueStats GetSendQueueStats() const { return audio_send_queue_.GetStats(); }
+    // Protocol::SendAudio() failed, the encoder controller backs off
+    void ReportSendFailure() { send_failures_++; }
+    // Snapshot of the encoder controller, not synchronized with the encoder task
+    OpusEncoderControllerStats GetEncoderControllerStats() const { return encoder_controller_.GetStats(); }
+    // Powers the input ahead of voice processing (button press, connecting), so it has settled by then
+    void PrepareInput();
+    AudioInputWarmupStats GetInputWarmupStats() const;
+    // Frames out of the audio processor and the overruns on its way, not synchronized with its task
+    AudioProcessorStats GetAudioProcessorStats();
     void SetModelsList(srmodel_list_t* models_list);
 
 private:
@@ -117,10 +252,11 @@ private:
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    AudioResampler input_resampler_;
+    AudioResampler reference_resampler_;
+    // Decoders and their output resamplers by stream, owned by the opus decoder task
+    AudioDecoderCache decoder_cache_;
+    AudioDecoderCache::Entry* decoder_ = nullptr;
     DebugStatistics debug_statistics_;
     srmodel_list_t* models_list_ = nullptr;
 
@@ -129,22 +265,124 @@ private:
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
+    TaskHandle_t opus_encoder_task_handle_ = nullptr;
+    TaskHandle_t opus_decoder_task_handle_ = nullptr;
+    // Wakes the opus encoder task: encode queue readable, send queue writable
+    AudioQueueEvent encoder_event_;
+    // Wakes the opus decoder task: decode queue readable, playback queue writable
+    AudioQueueEvent decoder_event_;
+    // Wakes the producers blocked on a full encode / decode queue
+    AudioQueueEvent encode_writable_event_;
+    AudioQueueEvent decode_writable_event_;
+    // Wakes the audio output task
+    AudioQueueEvent playback_event_;
+    AudioRingQueue<AudioStreamPacketPtr> audio_decode_queue_;
+    AudioSendQueue audio_send_queue_;
+    AudioRingQueue<AudioTaskPtr> audio_encode_queue_;
+    AudioRingQueue<AudioTaskPtr> audio_playback_queue_;
+    // PCM tasks are recycled with their buffers, packets come from AudioPacketPool
+    AudioObjectPool<AudioTask> audio_task_pool_;
+    // Reorders the downlink and conceals lost frames, owned by the opus decoder task
+    AudioJitterBuffer jitter_buffer_;
+    // Capture scratch buffers, owned by the audio input task
+    std::vector<int16_t> capture_buffer_;
+    std::vector<int16_t> capture_planar_buffer_;
+    // Aligns the loopback reference with the echo, owned by the audio input task
+    EchoDelayEstimator echo_delay_estimator_;
+    // Resampler output, swapped with the task buffer so both keep their capacity
+    std::vector<int16_t> output_resample_buffer_;
+    // The decode queue is fed by the network task and by the audio testing playback, serialize its producers
+    std::mutex decode_push_mutex_;
+    // Guards the queue off the hot path: audio testing
     std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
-    // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    std::deque<AudioStreamPacketPtr> audio_testing_queue_;
+    // Measured by the input and output tasks on the PCM they already hold
+    AudioLevelMeter level_meter_;
+    // For server AEC, the stream time of the audio leaving the DAC
+    AudioPlaybackClock playback_clock_;
+    // Plays a downlink backlog faster, owned by the opus decoder task
+    AudioTimeStretcher time_stretcher_;
+    std::vector<int16_t> time_stretch_buffer_;
+    // What the stretcher held back of the stream before a sample rate switch, at the output rate
+    std::vector<int16_t> time_stretch_flush_;
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
-    bool voice_detected_ = false;
-    bool service_stopped_ = true;
-    bool audio_input_need_warmup_ = false;
+    std::atomic<bool> voice_detected_ = false;
+    std::atomic<bool> service_stopped_ = true;
+    std::atomic<bool> decoder_reset_pending_ = false;
+    std::atomic<int> encode_frame_duration_ = OPUS_FRAME_DURATION_MS;
+    std::atomic<bool> silence_suppression_enabled_ = false;
+    std::atomic<uint32_t> uplink_sent_frames_ = 0;
+    std::atomic<uint32_t> uplink_suppressed_frames_ = 0;
+    std::atomic<uint32_t> uplink_suppressed_bytes_ = 0;
+    std::atomic<uint32_t> send_failures_ = 0;
+    // Adapts the encoder complexity to the CPU load and the uplink, owned by the opus encoder task
+    OpusEncoderController encoder_controller_;
+    // Silence suppression state, owned by the opus encoder task
+    bool silence_suppression_active_ = false;
+    int64_t last_voice_time_us_ = 0;
+    int64_t last_uplink_send_time_us_ = 0;
+    // The last suppressed frames, sent ahead of the speech so the VAD onset delay does not clip it
+    std::array<AudioStreamPacketPtr, UPLINK_SILENCE_PREROLL_PACKETS> silence_preroll_;
+    size_t silence_preroll_first_ = 0;
+    size_t silence_preroll_count_ = 0;
+    int silence_preroll_ms_ = 0;
+    // End of the last capture, the audio processor latency is measured from it
+    std::atomic<int64_t> last_capture_time_us_ = 0;
+    // When the codec input was last powered, and until when the power timer keeps it on
+    std::atomic<int64_t> input_enabled_time_us_ = 0;
+    std::atomic<int64_t> input_warm_until_us_ = 0;
+    // Barge-in: the detector is owned by the audio input task, which starts it when asked
+    BargeInDetector barge_in_detector_;
+    std::atomic<bool> barge_in_start_pending_ = false;
+    // Set on detection, the downlink still on its way is dropped until the detection is disabled
+    std::atomic<bool> barge_in_detected_ = false;
+    std::atomic<bool> device_aec_enabled_ = false;
+    // Mean square of the last frame played, the reference when the codec has no loopback channel
+    std::atomic<uint32_t> playback_energy_ = 0;
+    // Set when voice processing starts, the input task discards the reads until the ADC has settled
+    std::atomic<bool> input_warmup_pending_ = false;
+    int32_t input_warmup_remaining_samples_ = -1;
+    uint32_t input_warmup_discarded_samples_ = 0;
+    std::atomic<uint32_t> input_warmup_starts_ = 0;
+    std::atomic<uint32_t> input_warmup_cold_starts_ = 0;
+    std::atomic<uint32_t> input_warmup_discarded_ms_ = 0;
+    std::atomic<uint32_t> input_warmup_saved_ms_ = 0;
+
+    // Packet indexes of the sounds in flash, keyed by their data address
+    struct SoundIndexEntry {
+        size_t size = 0;
+        OggPacketIndex index;
+    };
+    std::mutex sound_index_mutex_;
+    std::map<const char*, SoundIndexEntry> sound_indexes_;
+    // Pre-decoded UI sounds, filled by the opus decoder task when it is idle
+    std::unique_ptr<SoundPcmCache> sound_pcm_cache_;
+    // A sound that is not cached, decoded while it plays; a sound outside flash is copied, the caller may free it
+    struct SoundRequest {
+        std::string data;
+        std::string_view ogg;
+        OggPacketIndex uncached;
+        const OggPacketIndex* index = nullptr;
+    };
+    // The sounds PlaySound asked for: cached ones go to the audio output task, the others to the
+    // opus decoder task. PlaySound runs on several tasks
+    std::mutex sound_push_mutex_;
+    AudioRingQueue<const SoundPcmCache::Entry*> cached_sounds_;
+    AudioRingQueue<std::unique_ptr<SoundRequest>> sound_queue_;
+    AudioRingQueue<AudioTaskPtr> sound_playback_queue_;
+    // The sound being decoded and its decoders, owned by the opus decoder task
+    std::unique_ptr<SoundRequest> decoding_sound_;
+    size_t decoding_sound_packet_ = 0;
+    std::atomic<bool> sound_decoding_ = false;
+    AudioDecoderCache sound_decoder_cache_;
+    std::vector<uint8_t> sound_payload_;
+    std::atomic<bool> mixer_reset_pending_ = false;
+    // Mixes the sounds over the playback stream, owned by the audio output task
+    AudioMixer mixer_;
+    std::vector<int16_t> mixer_buffer_;
+    std::atomic<bool> mixer_active_ = false;
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
@@ -152,10 +390,24 @@ private:
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
+    void OpusEncoderTask();
+    void OpusDecoderTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void ReservePackets(int uplink_frame_duration_ms);
+    void DecodeSoundFrame();
+    void UpdateCatchUpSpeed(int frame_duration);
     void CheckAndUpdateAudioPowerState();
+    void EnableInputPower();
+    bool DiscardInputWarmup(size_t samples);
+    void FeedBargeInDetector(const std::vector<int16_t>& data);
+    bool IsDecoderIdle();
+    bool IsSendQueueWritable();
+    void SendEncodedPacket(AudioStreamPacketPtr packet);
+    void KeepSilencePreroll(AudioStreamPacketPtr packet);
+    void SendSilencePreroll(int next_frame_ms);
+    void ReleaseSilencePreroll();
+    const OggPacketIndex& GetSoundIndex(const std::string_view& ogg, OggPacketIndex& uncached);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "audio_time_stretch.h"
+#include "audio_dsp.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Normalized cross-correlation of a candidate with the template, squared with its sign, every step-th sample
+static float Similarity(const int16_t* target, const int16_t* candidate, size_t samples, size_t step) {
+    int64_t correlation = 0;
+    int64_t energy = 0;
+    for (size_t i = 0; i < samples; i += step) {
+        correlation += target[i] * candidate[i];
+        energy += candidate[i] * candidate[i];
+    }
+    float c = (float)correlation;
+    return c * std::fabs(c) / ((float)energy + 1.0f);
+}
+
+void AudioTimeStretcher::Configure(int sample_rate) {
+    sample_rate_ = sample_rate;
+    hop_ = sample_rate * AUDIO_TIME_STRETCH_HOP_MS / 1000;
+    seek_ = sample_rate * AUDIO_TIME_STRETCH_SEEK_MS / 1000;
+    fade_.resize(hop_);
+    // Room for a few frames, so the dead samples are moved out every other frame at most
+    buffer_.reserve(sample_rate / 5);
+    for (size_t i = 0; i < hop_; i++) {
+        double s = std::sin(M_PI / 2 * (i + 0.5) / hop_);
+        fade_[i] = (int16_t)std::lround(s * s * 32767);
+    }
+    Reset();
+}
+
+void AudioTimeStretcher::SetSpeed(int speed_permille) {
+    speed_permille_ = std::max(1000, speed_permille);
+}
+
+size_t AudioTimeStretcher::Search(size_t center) {
+    const int16_t* target = buffer_.data() + tail_;
+    size_t low = center > seek_ ? center - seek_ : 0;
+    size_t high = center + seek_;
+
+    // Coarse: every other lag on every other sample
+    size_t best = low;
+    float best_score = -INFINITY;
+    for (size_t lag = low; lag <= high; lag += 2) {
+        float score = Similarity(target, buffer_.data() + lag, hop_, 2);
+        if (score > best_score) {
+            best_score = score;
+            best = lag;
+        }
+    }
+
+    // Fine: the neighbours of the best lag on every sample
+    size_t coarse = best;
+    best_score = -INFINITY;
+    for (size_t lag = std::max(low, coarse - 1); lag <= std::min(high, coarse + 1); lag++) {
+        float score = Similarity(target, buffer_.data() + lag, hop_, 1);
+        if (score > best_score) {
+            best_score = score;
+            best = lag;
+        }
+    }
+    return best;
+}
+
+void AudioTimeStretcher::Process(const int16_t* input, size_t samples, std::vector<int16_t>& output) {
+    if (!active_) {
+        if (speed_permille_ <= 1000 || hop_ == 0) {
+            output.insert(output.end(), input, input + samples);
+            return;
+        }
+        // The input so far has been played as it is, the next one continues it
+        active_ = true;
+        tail_ = 0;
+        nominal_milli_ = 0;
+    }
+    if (start_ > 0 && buffer_.size() + samples > buffer_.capacity()) {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + start_);
+        tail_ -= start_;
+        nominal_milli_ -= (int64_t)start_ * 1000;
+        start_ = 0;
+    }
+    buffer_.insert(buffer_.end(), input, input + samples);
+
+    if (speed_permille_ <= 1000) {
+        // Back to real time, the last cross-fade ended where the pending input continues
+        output.insert(output.end(), buffer_.begin() + tail_, buffer_.end());
+        Reset();
+        return;
+    }
+
+    while (true) {
+        int64_t next_milli = nominal_milli_ + (int64_t)hop_ * speed_permille_;
+        size_t center = (size_t)(next_milli / 1000);
+        if (tail_ + hop_ > buffer_.size() || center + seek_ + hop_ > buffer_.size()) {
+            break;
+        }
+
+        size_t position = Search(center);
+        const int16_t* fade_out = buffer_.data() + tail_;
+        const int16_t* fade_in = buffer_.data() + position;
+        size_t offset = output.size();
+        output.resize(offset + hop_);
+        int16_t* out = output.data() + offset;
+        for (size_t i = 0; i < hop_; i++) {
+            int32_t gain = fade_[i];
+            out[i] = AudioSaturate16((fade_out[i] * (32767 - gain) + fade_in[i] * gain + (1 << 14)) >> 15);
+        }
+        stats_.stretched_samples += hop_;
+        stats_.removed_samples += (int32_t)position - (int32_t)tail_;
+        tail_ = position + hop_;
+        nominal_milli_ = next_milli;
+    }
+
+    // Drop the input that neither the natural continuation nor the next search can reach, even at 1.0x
+    int64_t reachable = nominal_milli_ / 1000 + (int64_t)hop_ - (int64_t)seek_;
+    start_ = std::max(start_, (size_t)std::max<int64_t>(0, std::min<int64_t>(tail_, reachable)));
+}
+
+void AudioTimeStretcher::Reset() {
+    active_ = false;
+    buffer_.clear();
+    start_ = 0;
+    tail_ = 0;
+    nominal_milli_ = 0;
+}
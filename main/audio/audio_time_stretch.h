@@ -0,0 +1,67 @@
+#ifndef AUDIO_TIME_STRETCH_H
+#define AUDIO_TIME_STRETCH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Overlap of two segments, the output advances by this much per step
+#define AUDIO_TIME_STRETCH_HOP_MS 10
+// How far from its nominal position a segment may be taken to match the waveform
+#define AUDIO_TIME_STRETCH_SEEK_MS 5
+
+struct AudioTimeStretchStats {
+    uint32_t stretched_samples = 0;     // Output samples made while faster than real time
+    int32_t removed_samples = 0;        // Input samples skipped to catch up
+};
+
+/*
+ * WSOLA time-scale modification for mono 16-bit PCM, to play faster at the same pitch.
+ *
+ * At 1.0x the PCM goes through untouched. Faster, each step outputs AUDIO_TIME_STRETCH_HOP_MS
+ * while the input advances by the hop times the speed: the next segment is searched within
+ * AUDIO_TIME_STRETCH_SEEK_MS of its nominal position for the best match with the natural
+ * continuation of the audio played so far, and the two are cross-faded over the hop, so the
+ * cut falls between similar pitch periods. The search correlates every other sample at every
+ * other lag first, then refines around the best one.
+ *
+ * While faster it holds up to a segment and the seek range of input. Going back to 1.0x
+ * returns the rest of the input as it is, where the last cross-fade left off.
+ *
+ * Not thread safe, owned by the opus decoder task.
+ */
+class AudioTimeStretcher {
+public:
+    // Also resets, the pending input is dropped
+    void Configure(int sample_rate);
+    // 1000 plays at the original speed
+    void SetSpeed(int speed_permille);
+    int speed() const { return speed_permille_; }
+    // Appends the output for the input to output, which may end up shorter than the input
+    void Process(const int16_t* input, size_t samples, std::vector<int16_t>& output);
+    void Reset();
+    int sample_rate() const { return sample_rate_; }
+    AudioTimeStretchStats GetStats() const { return stats_; }
+
+private:
+    int sample_rate_ = 0;
+    size_t hop_ = 0;
+    size_t seek_ = 0;
+    int speed_permille_ = 1000;
+    bool active_ = false;
+    // Q15 fade-in over a hop, raised cosine; the fade-out is its complement
+    std::vector<int16_t> fade_;
+    // Input not played yet, from start_: the start of the natural continuation or the search range.
+    // The samples before start_ are dead, they are moved out only when the next input would not fit
+    std::vector<int16_t> buffer_;
+    size_t start_ = 0;
+    // Where the audio played so far continues in buffer_
+    size_t tail_ = 0;
+    // Nominal position of the next segment in buffer_, in thousandths of a sample
+    int64_t nominal_milli_ = 0;
+    AudioTimeStretchStats stats_;
+
+    size_t Search(size_t center);
+};
+
+#endif // AUDIO_TIME_STRETCH_H
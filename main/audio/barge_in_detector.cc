@@ -0,0 +1,87 @@
+#include "barge_in_detector.h"
+
+#include <esp_log.h>
+
+#include <algorithm>
+
+#define TAG "BargeInDetector"
+
+// Mean square of one channel of interleaved PCM
+static float ChannelEnergy(const int16_t* data, size_t frames, int channels) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < frames; i++) {
+        int32_t sample = data[i * channels];
+        sum += sample * sample;
+    }
+    return frames > 0 ? (float)sum / frames : 0;
+}
+
+void BargeInDetector::Start(BargeInMode mode) {
+    mode_ = mode;
+    detected_ = false;
+    elapsed_samples_ = 0;
+    warmup_samples_ = 0;
+    speech_samples_ = 0;
+    reference_hold_ = 0;
+    coupling_ = 1.0f;
+    noise_floor_ = BARGE_IN_MIN_ENERGY;
+    stats_.armed++;
+}
+
+bool BargeInDetector::IsSpeech(float input, float reference, size_t frames) {
+    // The reference level decays by about a quarter per block, the echo tail lasts a few hundred ms
+    reference_hold_ = std::max(reference, reference_hold_ * 0.75f);
+    // The noise floor drops at once and rises slowly
+    noise_floor_ = std::min(input, noise_floor_ * 1.02f + 1.0f);
+
+    float echo = coupling_ * reference_hold_;
+    bool speech = input > BARGE_IN_MIN_ENERGY && input > BARGE_IN_ECHO_MARGIN * (echo + noise_floor_);
+    // Learn the coupling from the echo: every block while warming up, quickly upwards, then the blocks without speech
+    bool warming_up = warmup_samples_ < BARGE_IN_WARMUP_MS * 16;
+    if ((warming_up || !speech) && reference_hold_ > BARGE_IN_MIN_ENERGY) {
+        float ratio = input / reference_hold_;
+        float rate = (warming_up && ratio > coupling_) ? 0.5f : 0.05f;
+        coupling_ += (ratio - coupling_) * rate;
+        // Only the blocks with playback teach the coupling
+        warmup_samples_ += frames;
+    }
+    return speech;
+}
+
+bool BargeInDetector::Process(const int16_t* input, const int16_t* reference, size_t frames, int channels,
+    uint32_t playback_energy, bool voice_detected) {
+    if (detected_ || frames == 0) {
+        return false;
+    }
+
+    bool speech;
+    if (mode_ == kBargeInModeVad) {
+        speech = voice_detected;
+        // The AFE needs a moment for its echo canceller to converge
+        warmup_samples_ += frames;
+    } else {
+        float input_energy = ChannelEnergy(input, frames, channels);
+        float reference_energy = reference ? ChannelEnergy(reference, frames, channels) : (float)playback_energy;
+        speech = IsSpeech(input_energy, reference_energy, frames);
+    }
+
+    elapsed_samples_ += frames;
+    if (warmup_samples_ < BARGE_IN_WARMUP_MS * 16) {
+        return false;
+    }
+    if (speech) {
+        speech_samples_ += frames;
+    } else {
+        speech_samples_ -= std::min<uint32_t>(speech_samples_, frames / 2);
+    }
+    if (speech_samples_ < CONFIG_BARGE_IN_MIN_SPEECH_MS * 16) {
+        return false;
+    }
+
+    detected_ = true;
+    stats_.detections++;
+    stats_.last_detection_ms = elapsed_samples_ / 16;
+    ESP_LOGI(TAG, "Barge-in detected after %lu ms (%s)", (unsigned long)stats_.last_detection_ms,
+        mode_ == kBargeInModeVad ? "vad" : "energy");
+    return true;
+}
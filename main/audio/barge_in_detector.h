@@ -0,0 +1,70 @@
+#ifndef BARGE_IN_DETECTOR_H
+#define BARGE_IN_DETECTOR_H
+
+#include <cstdint>
+#include <cstddef>
+
+// The option only exists with CONFIG_USE_BARGE_IN_DETECTION
+#ifndef CONFIG_BARGE_IN_MIN_SPEECH_MS
+#define CONFIG_BARGE_IN_MIN_SPEECH_MS 200
+#endif
+
+// The first playback after arming only teaches the echo level, nothing is detected
+#define BARGE_IN_WARMUP_MS 300
+// Speech has to be this much louder than the expected echo and noise (power ratio, 9 dB)
+#define BARGE_IN_ECHO_MARGIN 8
+// ... and above this level (mean square, about -45 dBFS)
+#define BARGE_IN_MIN_ENERGY 34000
+
+enum BargeInMode {
+    kBargeInModeVad,        // The AFE VAD on the echo cancelled input
+    kBargeInModeEnergy,     // The input energy against the playback reference
+};
+
+struct BargeInStats {
+    uint32_t armed = 0;         // Speaking turns the detector ran in
+    uint32_t detections = 0;
+    uint32_t last_detection_ms = 0;     // Time from arming to the last detection
+};
+
+/*
+ * Tells when the user talks over the assistant.
+ *
+ * With device AEC the AFE VAD already hears the user only, and the detector waits for
+ * CONFIG_BARGE_IN_MIN_SPEECH_MS of speech. Without it, each input block is compared with
+ * the playback: the echo coupling (input energy over reference energy) is learned from the
+ * first BARGE_IN_WARMUP_MS of playback, then from the blocks that are not speech, and a
+ * block counts as speech when it is BARGE_IN_ECHO_MARGIN times louder than the echo
+ * expected from the reference plus the noise floor. The reference is the second input
+ * channel when the codec loops it back, otherwise the energy of the frames played. Its
+ * level is held for a while, so the echo delay does not matter. Short gaps between the
+ * syllables are forgiven.
+ *
+ * Not thread safe, owned by the audio input task.
+ */
+class BargeInDetector {
+public:
+    void Start(BargeInMode mode);
+    // One block of interleaved input. reference points into it when the codec loops the
+    // playback back, otherwise playback_energy is the mean square of the frames played.
+    // Returns true once, on detection.
+    bool Process(const int16_t* input, const int16_t* reference, size_t frames, int channels,
+        uint32_t playback_energy, bool voice_detected);
+    BargeInMode mode() const { return mode_; }
+    BargeInStats GetStats() const { return stats_; }
+
+private:
+    BargeInMode mode_ = kBargeInModeEnergy;
+    bool detected_ = false;
+    uint32_t elapsed_samples_ = 0;
+    uint32_t warmup_samples_ = 0;
+    uint32_t speech_samples_ = 0;
+    float reference_hold_ = 0;
+    float coupling_ = 1.0f;
+    float noise_floor_ = 0;
+    BargeInStats stats_;
+
+    bool IsSpeech(float input, float reference, size_t frames);
+};
+
+#endif // BARGE_IN_DETECTOR_H
@@ -0,0 +1,222 @@
+#include "echo_delay_estimator.h"
+
+#include <esp_log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#define TAG "EchoDelayEstimator"
+
+void EchoDelayEstimator::Configure(int sample_rate) {
+    sample_rate_ = sample_rate;
+    max_lag_ = sample_rate * ECHO_DELAY_MAX_MS / 1000 / ECHO_DELAY_DECIMATION;
+    window_ = sample_rate * ECHO_DELAY_WINDOW_MS / 1000 / ECHO_DELAY_DECIMATION;
+    mic_sum_ = 0;
+    reference_sum_ = 0;
+    phase_ = 0;
+    std::fill(std::begin(autocorrelation_), std::end(autocorrelation_), 0.0f);
+    std::fill(std::begin(predictor_), std::end(predictor_), 0.0f);
+    predictor_[0] = 1;
+    std::fill(std::begin(mic_history_), std::end(mic_history_), 0.0f);
+    std::fill(std::begin(reference_history_), std::end(reference_history_), 0.0f);
+    mic_.clear();
+    reference_.clear();
+    correlation_.assign(max_lag_ + 1, 0);
+    reference_energy_.assign(max_lag_ + 1, 0);
+    mic_energy_ = 0;
+    correlated_ = 0;
+    candidate_ = -1;
+    delay_line_.assign(max_lag_ * ECHO_DELAY_DECIMATION + 1, 0);
+    delay_write_ = 0;
+    stats_ = EchoDelayStats();
+}
+
+void EchoDelayEstimator::Process(int16_t* input, size_t frames, int channels) {
+    if (channels < 2 || sample_rate_ == 0) {
+        return;
+    }
+
+    /* Decimate both channels */
+    int64_t reference_power = 0;
+    mic_.clear();
+    block_reference_.clear();
+    for (size_t i = 0; i < frames; i++) {
+        int32_t mic = input[i * channels];
+        int32_t reference = input[i * channels + 1];
+        reference_power += reference * reference;
+        mic_sum_ += mic;
+        reference_sum_ += reference;
+        if (++phase_ == ECHO_DELAY_DECIMATION) {
+            mic_.push_back(mic_sum_ / ECHO_DELAY_DECIMATION);
+            block_reference_.push_back(reference_sum_ / ECHO_DELAY_DECIMATION);
+            mic_sum_ = 0;
+            reference_sum_ = 0;
+            phase_ = 0;
+        }
+    }
+
+    /* Whiten them with the same predictor, only the playback tells anything about the echo path */
+    bool playing = frames > 0 && reference_power / (int64_t)frames >= ECHO_DELAY_MIN_REFERENCE_ENERGY;
+    if (playing) {
+        UpdatePredictor();
+    }
+    Whiten(mic_.data(), mic_.size(), mic_history_);
+    Whiten(block_reference_.data(), block_reference_.size(), reference_history_);
+    reference_.insert(reference_.end(), block_reference_.begin(), block_reference_.end());
+    if (playing && !mic_.empty() && reference_.size() >= mic_.size() + max_lag_) {
+        Correlate();
+        if (correlated_ >= window_) {
+            Estimate();
+        }
+    }
+    if (reference_.size() > max_lag_) {
+        reference_.erase(reference_.begin(), reference_.end() - max_lag_);
+    }
+
+    /* Delay the reference, on the raw samples */
+    const size_t size = delay_line_.size();
+    const size_t delay = stats_.delay_samples;
+    for (size_t i = 0; i < frames; i++) {
+        int16_t& reference = input[i * channels + 1];
+        delay_line_[delay_write_] = reference;
+        reference = delay_line_[(delay_write_ + size - delay) % size];
+        delay_write_ = (delay_write_ + 1) % size;
+    }
+}
+
+void EchoDelayEstimator::UpdatePredictor() {
+    /* Smoothed over about ten blocks, so the predictor stays the same across the echo delay */
+    const float* x = block_reference_.data();
+    const size_t n = block_reference_.size();
+    for (int k = 0; k <= ECHO_DELAY_WHITENING_ORDER; k++) {
+        float sum = 0;
+        for (size_t i = k; i < n; i++) {
+            sum += x[i] * x[i - k];
+        }
+        autocorrelation_[k] = autocorrelation_[k] * 0.9f + sum;
+    }
+
+    /* Levinson-Durbin, with a little white noise added for a well conditioned predictor */
+    float a[ECHO_DELAY_WHITENING_ORDER + 1] = {1};
+    float error = autocorrelation_[0] * 1.001f + 1.0f;
+    for (int i = 1; i <= ECHO_DELAY_WHITENING_ORDER; i++) {
+        float acc = autocorrelation_[i];
+        for (int j = 1; j < i; j++) {
+            acc += a[j] * autocorrelation_[i - j];
+        }
+        float k = -acc / error;
+        float previous[ECHO_DELAY_WHITENING_ORDER + 1];
+        std::copy(a, a + i, previous);
+        for (int j = 1; j < i; j++) {
+            a[j] = previous[j] + k * previous[i - j];
+        }
+        a[i] = k;
+        error *= 1 - k * k;
+    }
+    std::copy(a, a + ECHO_DELAY_WHITENING_ORDER + 1, predictor_);
+}
+
+void EchoDelayEstimator::Whiten(float* samples, size_t count, float* history) {
+    /* history holds the last inputs, newest first */
+    for (size_t i = 0; i < count; i++) {
+        float x = samples[i];
+        float y = x;
+        for (int k = 1; k <= ECHO_DELAY_WHITENING_ORDER; k++) {
+            y += predictor_[k] * history[k - 1];
+        }
+        std::copy_backward(history, history + ECHO_DELAY_WHITENING_ORDER - 1, history + ECHO_DELAY_WHITENING_ORDER);
+        history[0] = x;
+        samples[i] = y;
+    }
+}
+
+void EchoDelayEstimator::Correlate() {
+    const size_t n = mic_.size();
+    const float* mic = mic_.data();
+    // The reference block aligned with the microphone block, lag 0
+    const float* block = reference_.data() + reference_.size() - n;
+
+    float energy = 0;
+    float mic_energy = 0;
+    for (size_t k = 0; k < n; k++) {
+        energy += block[k] * block[k];
+        mic_energy += mic[k] * mic[k];
+    }
+    for (size_t lag = 0; lag <= max_lag_; lag++) {
+        const float* reference = block - lag;
+        float sum = 0;
+        for (size_t k = 0; k < n; k++) {
+            sum += mic[k] * reference[k];
+        }
+        correlation_[lag] += sum;
+        reference_energy_[lag] += energy;
+        // Slide the reference window one sample back for the next lag
+        if (lag < max_lag_) {
+            energy += reference[-1] * reference[-1] - reference[n - 1] * reference[n - 1];
+        }
+    }
+    mic_energy_ += mic_energy;
+    correlated_ += n;
+}
+
+void EchoDelayEstimator::Estimate() {
+    // Squared normalized correlation
+    auto normalized = [this](size_t lag) {
+        return correlation_[lag] * correlation_[lag] / (reference_energy_[lag] + 1.0f) / (mic_energy_ + 1.0f);
+    };
+
+    size_t best = 0;
+    float peak = 0;
+    for (size_t lag = 0; lag <= max_lag_; lag++) {
+        float score = normalized(lag);
+        if (score > peak) {
+            peak = score;
+            best = lag;
+        }
+    }
+    // Between the decimated lags: the vertex of the parabola through the peak and its neighbours
+    float offset = 0;
+    if (best > 0 && best < max_lag_) {
+        float sign = correlation_[best] < 0 ? -1.0f : 1.0f;
+        float left = sign * correlation_[best - 1] / std::sqrt(reference_energy_[best - 1] + 1.0f);
+        float center = sign * correlation_[best] / std::sqrt(reference_energy_[best] + 1.0f);
+        float right = sign * correlation_[best + 1] / std::sqrt(reference_energy_[best + 1] + 1.0f);
+        float curvature = left - 2 * center + right;
+        if (curvature < 0) {
+            offset = std::max(-0.5f, std::min(0.5f, 0.5f * (left - right) / curvature));
+        }
+    }
+    peak = std::min(peak, 0.9999f);
+    float unaligned = std::min(normalized(0), 0.9999f);
+
+    // The next window still remembers this one, at half the weight
+    for (size_t lag = 0; lag <= max_lag_; lag++) {
+        correlation_[lag] *= 0.5f;
+        reference_energy_[lag] *= 0.5f;
+    }
+    mic_energy_ *= 0.5f;
+    correlated_ = 0;
+
+    if (peak < ECHO_DELAY_MIN_CORRELATION * ECHO_DELAY_MIN_CORRELATION) {
+        candidate_ = -1;
+        return;
+    }
+    stats_.estimates++;
+    if (candidate_ >= 0 && std::abs((int)best - candidate_) <= 1) {
+        int margin = ECHO_DELAY_MARGIN_MS * sample_rate_ / 1000;
+        int estimate = std::lround((best + offset) * ECHO_DELAY_DECIMATION);
+        uint32_t delay = std::min<uint32_t>(std::max(0, estimate - margin), delay_line_.size() - 1);
+        stats_.correlation = std::sqrt(peak);
+        stats_.erle_db = -10 * std::log10(1 - peak);
+        stats_.erle_gain_db = stats_.erle_db + 10 * std::log10(1 - unaligned);
+        // The refinement wanders by a sample from window to window, the delay line does not follow that
+        if (std::abs((int)delay - (int)stats_.delay_samples) > 1) {
+            stats_.delay_samples = delay;
+            stats_.changes++;
+            ESP_LOGI(TAG, "Echo delay %.2f ms, correlation %.2f, ERLE %.1f dB (%+.1f dB)", delay * 1000.0f / sample_rate_,
+                stats_.correlation, stats_.erle_db, stats_.erle_gain_db);
+        }
+    }
+    candidate_ = best;
+}
@@ -0,0 +1,94 @@
+#ifndef ECHO_DELAY_ESTIMATOR_H
+#define ECHO_DELAY_ESTIMATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Longest speaker to microphone delay searched, and compensated, behind the reference
+#define ECHO_DELAY_MAX_MS 160
+// The correlation runs on a decimated copy, at a quarter of the input rate
+#define ECHO_DELAY_DECIMATION 4
+// Linear predictor that whitens both decimated channels
+#define ECHO_DELAY_WHITENING_ORDER 8
+// Playback correlated before each estimate, the older correlation then counts half
+#define ECHO_DELAY_WINDOW_MS 1000
+// Blocks whose reference is quieter than this (mean square, about -50 dBFS) are not correlated
+#define ECHO_DELAY_MIN_REFERENCE_ENERGY 10000
+// Normalized correlation an estimate needs to be trusted
+#define ECHO_DELAY_MIN_CORRELATION 0.25f
+// Applied short of the estimate, so an estimate a little long never puts the reference after the echo
+#define ECHO_DELAY_MARGIN_MS 2
+
+struct EchoDelayStats {
+    uint32_t delay_samples = 0;     // Applied to the reference, at the input rate, the margin taken off
+    uint32_t estimates = 0;         // Windows with a trusted peak
+    uint32_t changes = 0;           // Times the applied delay moved
+    float correlation = 0;          // Of the last trusted peak
+    float erle_db = 0;              // Echo a one-tap canceller removes at the estimated delay
+    float erle_gain_db = 0;         // ... over the same canceller without the compensation
+};
+
+/*
+ * Finds how far the echo in the microphone channel lags the playback reference channel,
+ * and delays the reference by as much, so the AEC sees them aligned.
+ *
+ * Both channels are decimated by ECHO_DELAY_DECIMATION and whitened by the same linear
+ * predictor, fitted to the reference: the formants and the pitch of speech would otherwise
+ * make the correlation ring, with sidelobes as high as the peak. While the reference is
+ * playing, every block is cross-correlated at each lag up to ECHO_DELAY_MAX_MS. After
+ * ECHO_DELAY_WINDOW_MS of playback, the lag with the highest normalized correlation, refined
+ * between the decimated lags by a parabola, is the estimate; it is applied once two windows
+ * in a row agree on it, less ECHO_DELAY_MARGIN_MS. The AEC filter covers a reference that
+ * leads the echo, not one that lags it, so the error of the estimate is kept on that side.
+ *
+ * The ERLE figures are those of a single-tap canceller on the decimated signals, at the
+ * estimated lag and at lag 0: they show what the alignment gains, not what the AEC reaches.
+ * A reference that lags the microphone cannot be compensated and leaves the delay at 0.
+ *
+ * Not thread safe, owned by the audio input task.
+ */
+class EchoDelayEstimator {
+public:
+    void Configure(int sample_rate);
+    // Estimates on the raw channels, then delays the reference (channel 1) in place
+    void Process(int16_t* input, size_t frames, int channels);
+    int sample_rate() const { return sample_rate_; }
+    EchoDelayStats GetStats() const { return stats_; }
+
+private:
+    int sample_rate_ = 0;
+    size_t max_lag_ = 0;                // Decimated samples
+    size_t window_ = 0;                 // Decimated samples
+    // Decimation state, partial sums
+    float mic_sum_ = 0;
+    float reference_sum_ = 0;
+    int phase_ = 0;
+    // Whitening: smoothed autocorrelation of the reference, predictor, and the last decimated samples
+    float autocorrelation_[ECHO_DELAY_WHITENING_ORDER + 1] = {};
+    float predictor_[ECHO_DELAY_WHITENING_ORDER + 1] = {1};
+    float mic_history_[ECHO_DELAY_WHITENING_ORDER] = {};
+    float reference_history_[ECHO_DELAY_WHITENING_ORDER] = {};
+    // Decimated block before whitening
+    std::vector<float> block_reference_;
+    // Whitened decimated signals, the block for the microphone and max_lag_ more for the reference
+    std::vector<float> mic_;
+    std::vector<float> reference_;
+    // Accumulated over the windows: correlation and reference energy per lag, microphone energy
+    std::vector<float> correlation_;
+    std::vector<float> reference_energy_;
+    float mic_energy_ = 0;
+    size_t correlated_ = 0;
+    int candidate_ = -1;
+    // Reference delay line at the input rate
+    std::vector<int16_t> delay_line_;
+    size_t delay_write_ = 0;
+    EchoDelayStats stats_;
+
+    void UpdatePredictor();
+    void Whiten(float* samples, size_t count, float* history);
+    void Correlate();
+    void Estimate();
+};
+
+#endif // ECHO_DELAY_ESTIMATOR_H
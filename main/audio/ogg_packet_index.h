@@ -0,0 +1,26 @@
+#ifndef OGG_PACKET_INDEX_H
+#define OGG_PACKET_INDEX_H
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/*
+ * The Opus packets of an Ogg Opus file, as offsets into the file data.
+ *
+ * Build() parses the pages once, then the packets can be read straight from the
+ * (flash mapped) data without scanning for pages again.
+ */
+struct OggPacketIndex {
+    struct Packet {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    int sample_rate = 16000;
+    std::vector<Packet> packets;
+
+    void Build(const std::string_view& ogg);
+};
+
+#endif // OGG_PACKET_INDEX_H
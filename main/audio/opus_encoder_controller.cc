@@ -0,0 +1,79 @@
+#include "opus_encoder_controller.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusEncoderController"
+
+OpusEncoderController::OpusEncoderController(int min_complexity, int max_complexity)
+    : min_complexity_(min_complexity), max_complexity_(max_complexity), complexity_(min_complexity) {
+}
+
+bool OpusEncoderController::Update(int64_t now_us, int64_t encode_us, int frame_duration_ms, int send_queue_ms,
+    uint32_t send_failures) {
+    if (frame_duration_ms <= 0) {
+        return false;
+    }
+    // Encode time over frame duration, smoothed over about eight frames
+    uint32_t load = encode_us / frame_duration_ms;
+    load_permille_ = load_permille_ == 0 ? load : (load_permille_ * 7 + load) / 8;
+
+    /* The uplink does not keep up: drop to the cheapest setting and stay there for a while */
+    bool failed = send_failures != last_send_failures_;
+    last_send_failures_ = send_failures;
+    bool congested = failed || send_queue_ms >= OPUS_CONTROLLER_CONGESTED_QUEUE_MS;
+    if (congested && !congested_) {
+        congestion_events_++;
+    }
+    congested_ = congested;
+    if (congested) {
+        return StepDown(now_us, complexity_ - min_complexity_, OPUS_CONTROLLER_CONGESTION_HOLD_MS);
+    }
+
+    /* The encoder takes too much of the frame time, give the other tasks their CPU back */
+    if (load_permille_ > OPUS_CONTROLLER_HIGH_LOAD_PERMILLE) {
+        // One step per hold, the smoothed load takes a few frames to show the previous one
+        if (now_us < hold_until_us_) {
+            calm_since_us_ = now_us;
+            return false;
+        }
+        return StepDown(now_us, 1, OPUS_CONTROLLER_LOAD_HOLD_MS);
+    }
+
+    /* Step up only after a calm period: low load and no more than a frame waiting to be sent */
+    if (load_permille_ > OPUS_CONTROLLER_LOW_LOAD_PERMILLE || send_queue_ms > frame_duration_ms || calm_since_us_ == 0) {
+        calm_since_us_ = now_us;
+        return false;
+    }
+    if (complexity_ >= max_complexity_ || now_us < hold_until_us_ ||
+        now_us - calm_since_us_ < OPUS_CONTROLLER_RAISE_INTERVAL_MS * 1000LL) {
+        return false;
+    }
+    complexity_++;
+    raises_++;
+    calm_since_us_ = now_us;
+    ESP_LOGI(TAG, "Complexity raised to %d, load %lu permille", complexity_, (unsigned long)load_permille_);
+    return true;
+}
+
+bool OpusEncoderController::StepDown(int64_t now_us, int steps, int hold_ms) {
+    hold_until_us_ = now_us + hold_ms * 1000LL;
+    calm_since_us_ = now_us;
+    if (steps <= 0 || complexity_ <= min_complexity_) {
+        return false;
+    }
+    complexity_ = complexity_ - steps < min_complexity_ ? min_complexity_ : complexity_ - steps;
+    drops_++;
+    ESP_LOGI(TAG, "Complexity dropped to %d, load %lu permille%s", complexity_, (unsigned long)load_permille_,
+        congested_ ? ", uplink congested" : "");
+    return true;
+}
+
+OpusEncoderControllerStats OpusEncoderController::GetStats() const {
+    OpusEncoderControllerStats stats;
+    stats.complexity = complexity_;
+    stats.load_permille = load_permille_;
+    stats.raises = raises_;
+    stats.drops = drops_;
+    stats.congestion_events = congestion_events_;
+    return stats;
+}
@@ -0,0 +1,61 @@
+#ifndef OPUS_ENCODER_CONTROLLER_H
+#define OPUS_ENCODER_CONTROLLER_H
+
+#include <cstdint>
+
+// Encode time, in permille of the frame duration, above which the complexity steps down
+#define OPUS_CONTROLLER_HIGH_LOAD_PERMILLE 400
+// ... and below which it may step up
+#define OPUS_CONTROLLER_LOW_LOAD_PERMILLE 150
+// Audio waiting in the send queue that counts as congestion
+#define OPUS_CONTROLLER_CONGESTED_QUEUE_MS 240
+// Calm time needed before each step up, and the hold after a step down
+#define OPUS_CONTROLLER_RAISE_INTERVAL_MS 3000
+#define OPUS_CONTROLLER_LOAD_HOLD_MS 30000
+#define OPUS_CONTROLLER_CONGESTION_HOLD_MS 10000
+
+struct OpusEncoderControllerStats {
+    int complexity = 0;
+    uint32_t load_permille = 0;     // Smoothed encode time over frame duration
+    uint32_t raises = 0;
+    uint32_t drops = 0;
+    uint32_t congestion_events = 0; // Send queue backlog or send failures
+};
+
+/*
+ * Picks the Opus encoder complexity from how the uplink is doing.
+ *
+ * The encoder task reports every frame: its encode time, the audio waiting in the send
+ * queue and the send failures so far. A congested uplink drops the complexity to the
+ * minimum at once; an encoder using too much of the frame time steps it down one level,
+ * then holds it for OPUS_CONTROLLER_LOAD_HOLD_MS before the next step. A calm uplink with
+ * CPU to spare steps it up one level at a time, at most every OPUS_CONTROLLER_RAISE_INTERVAL_MS.
+ *
+ * Not thread safe, owned by the opus encoder task.
+ */
+class OpusEncoderController {
+public:
+    OpusEncoderController(int min_complexity, int max_complexity);
+
+    // Returns true when the complexity changed and has to be applied to the encoder
+    bool Update(int64_t now_us, int64_t encode_us, int frame_duration_ms, int send_queue_ms, uint32_t send_failures);
+    int complexity() const { return complexity_; }
+    OpusEncoderControllerStats GetStats() const;
+
+private:
+    int min_complexity_;
+    int max_complexity_;
+    int complexity_;
+    uint32_t load_permille_ = 0;
+    uint32_t last_send_failures_ = 0;
+    int64_t calm_since_us_ = 0;
+    int64_t hold_until_us_ = 0;
+    uint32_t raises_ = 0;
+    uint32_t drops_ = 0;
+    uint32_t congestion_events_ = 0;
+    bool congested_ = false;
+
+    bool StepDown(int64_t now_us, int steps, int hold_ms);
+};
+
+#endif // OPUS_ENCODER_CONTROLLER_H
@@ -1,21 +1,25 @@
 #include "afe_audio_processor.h"
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #define PROCESSOR_RUNNING 0x01
 
 #define TAG "AfeAudioProcessor"
 
 AfeAudioProcessor::AfeAudioProcessor()
-    : afe_data_(nullptr) {
+    : afe_data_(nullptr),
+      assembler_(AFE_OUTPUT_RING_MS * 16000 / 1000),
+      frame_pool_("AfeFrame", [](std::vector<int16_t>& frame) {
+          frame.clear();
+      }) {
     event_group_ = xEventGroupCreate();
 }
 
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
-
-    // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
+    // The service copies each frame out in the callback, so one buffer is enough
+    frame_pool_.Reserve(1);
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -81,6 +85,10 @@ AfeAudioProcessor::~AfeAudioProcessor() {
     vEventGroupDelete(event_group_);
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
 size_t AfeAudioProcessor::GetFeedSize() {
     if (afe_data_ == nullptr) {
         return 0;
@@ -129,6 +137,8 @@ void AfeAudioProcessor::AudioProcessorTask() {
 
         auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
         if ((xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING) == 0) {
+            // Do not prepend a partial frame of this session to the next one
+            assembler_.Reset();
             continue;
         }
         if (res == nullptr || res->ret_value == ESP_FAIL) {
@@ -149,24 +159,21 @@ void AfeAudioProcessor::AudioProcessorTask() {
             }
         }
 
+        // The feed ran ahead of the fetch and filled the AFE input ring
+        if (res->ringbuff_free_pct <= 0) {
+            if (afe_overruns_++ % 100 == 0) {
+                ESP_LOGW(TAG, "AFE ring buffer full (%lu times)", (unsigned long)afe_overruns_);
+            }
+        }
+
         if (output_callback_) {
-            size_t samples = res->data_size / sizeof(int16_t);
-            
-            // Add data to buffer
-            output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
-            
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
+            assembler_.SetFrameSamples(frame_samples_);
+            assembler_.Push(res->data, res->data_size / sizeof(int16_t), esp_timer_get_time());
+
+            // Output complete frames when the ring has enough data
+            auto frame = frame_pool_.Acquire();
+            while (assembler_.Pop(*frame)) {
+                output_callback_(std::move(*frame));
             }
         }
     }
@@ -185,3 +192,12 @@ void AfeAudioProcessor::EnableDeviceAec(bool enable) {
         afe_iface_->enable_vad(afe_data_);
     }
 }
+
+AudioProcessorStats AfeAudioProcessor::GetStats() {
+    auto assembler_stats = assembler_.GetStats();
+    AudioProcessorStats stats;
+    stats.frames = assembler_stats.frames;
+    stats.afe_overruns = afe_overruns_;
+    stats.assembler_overruns = assembler_stats.overruns;
+    return stats;
+}
@@ -9,9 +9,15 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "audio_frame_assembler.h"
+#include "audio_pool.h"
+
+// Processed audio waiting to make a frame, room for the longest frame and a few AFE fetches
+#define AFE_OUTPUT_RING_MS 240
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -19,6 +25,7 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void SetFrameDuration(int frame_duration_ms) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
@@ -27,6 +34,7 @@ public:
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
+    AudioProcessorStats GetStats() override;
 
 private:
     EventGroupHandle_t event_group_ = nullptr;
@@ -35,9 +43,12 @@ private:
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
+    std::atomic<int> frame_samples_ = 0;
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    // Owned by the processor task
+    AudioFrameAssembler assembler_;
+    AudioObjectPool<std::vector<int16_t>> frame_pool_;
+    uint32_t afe_overruns_ = 0;
 
     void AudioProcessorTask();
 };
@@ -0,0 +1,143 @@
+#include "sound_pcm_cache.h"
+#include "ogg_packet_index.h"
+#include "audio_resampler.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <opus_decoder.h>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+#define TAG "SoundPcmCache"
+
+// Prompts are encoded with 60 ms frames, the same as PlaySound assumes
+#define SOUND_FRAME_DURATION_MS 60
+
+SoundPcmCache::SoundPcmCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {
+}
+
+SoundPcmCache::~SoundPcmCache() {
+    for (auto& [key, entry] : entries_) {
+        heap_caps_free(entry.pcm);
+    }
+}
+
+void SoundPcmCache::Register(const std::string_view& ogg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!registered_.insert(ogg.data()).second) {
+        return;
+    }
+    pending_.push_back(ogg);
+    has_pending_ = true;
+}
+
+void SoundPcmCache::Fill(int sample_rate) {
+    std::vector<std::string_view> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending.swap(pending_);
+        has_pending_ = false;
+    }
+
+    for (auto& ogg : pending) {
+        Entry entry;
+        if (!Decode(ogg, sample_rate, entry)) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[ogg.data()] = entry;
+        used_bytes_ += entry.bytes;
+        ESP_LOGI(TAG, "Cached sound %p: %u samples, %u/%u bytes used", ogg.data(), entry.samples, used_bytes_, budget_bytes_);
+    }
+}
+
+bool SoundPcmCache::Decode(const std::string_view& ogg, int sample_rate, Entry& entry) {
+    OggPacketIndex index;
+    index.Build(ogg);
+    if (index.packets.empty()) {
+        return false;
+    }
+
+    // Resampled once per sound, so it can afford the best filter
+    AudioResampler resampler;
+    if (index.sample_rate != sample_rate) {
+        resampler.Configure(index.sample_rate, sample_rate, kAudioResamplerQualityHigh);
+    }
+    size_t frame_samples = sample_rate * SOUND_FRAME_DURATION_MS / 1000;
+    size_t capacity = index.packets.size() * frame_samples;
+    size_t bytes = capacity * sizeof(int16_t);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (used_bytes_ + bytes > budget_bytes_) {
+            ESP_LOGW(TAG, "Sound %p needs %u bytes, over the cache budget", ogg.data(), bytes);
+            return false;
+        }
+    }
+    auto pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (pcm == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for sound %p", bytes, ogg.data());
+        return false;
+    }
+
+    auto decoder = std::make_unique<OpusDecoderWrapper>(index.sample_rate, 1, SOUND_FRAME_DURATION_MS);
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
+    std::vector<uint8_t> payload;
+    std::vector<int16_t> decoded;
+    std::vector<int16_t> resampled;
+    size_t samples = 0;
+    for (const auto& item : index.packets) {
+        payload.assign(buf + item.offset, buf + item.offset + item.size);
+        if (!decoder->Decode(std::move(payload), decoded)) {
+            ESP_LOGE(TAG, "Failed to decode sound %p", ogg.data());
+            heap_caps_free(pcm);
+            return false;
+        }
+        const std::vector<int16_t>* output = &decoded;
+        if (index.sample_rate != sample_rate) {
+            resampled.resize(resampler.GetOutputSamples(decoded.size()));
+            resampler.Process(decoded.data(), decoded.size(), resampled.data());
+            output = &resampled;
+        }
+        size_t count = std::min(output->size(), capacity - samples);
+        memcpy(pcm + samples, output->data(), count * sizeof(int16_t));
+        samples += count;
+    }
+
+    entry.pcm = pcm;
+    entry.samples = samples;
+    entry.bytes = bytes;
+    return true;
+}
+
+const SoundPcmCache::Entry* SoundPcmCache::Find(const std::string_view& ogg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(ogg.data());
+    if (it == entries_.end()) {
+        if (registered_.count(ogg.data()) != 0) {
+            misses_++;
+        }
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void SoundPcmCache::CountFound(bool played) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (played) {
+        hits_++;
+    } else {
+        misses_++;
+    }
+}
+
+SoundPcmCacheStats SoundPcmCache::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SoundPcmCacheStats stats;
+    stats.entries = entries_.size();
+    stats.used_bytes = used_bytes_;
+    stats.budget_bytes = budget_bytes_;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    return stats;
+}
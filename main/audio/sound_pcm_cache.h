@@ -0,0 +1,66 @@
+#ifndef SOUND_PCM_CACHE_H
+#define SOUND_PCM_CACHE_H
+
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+struct SoundPcmCacheStats {
+    uint32_t entries = 0;
+    uint32_t used_bytes = 0;
+    uint32_t budget_bytes = 0;
+    uint32_t hits = 0;
+    uint32_t misses = 0;            // Registered sounds played without PCM: pending, over budget, undecodable,
+                                    // or found while the mixer had no room for it
+};
+
+/*
+ * Decoded and resampled PCM of short prompts, kept in PSRAM.
+ *
+ * Register() queues a sound, the decoder task decodes it with Fill() when it has
+ * nothing else to do. Entries are never evicted: once the budget is used up, further
+ * sounds stay uncached and are decoded while they play.
+ */
+class SoundPcmCache {
+public:
+    struct Entry {
+        int16_t* pcm = nullptr;
+        size_t samples = 0;
+        size_t bytes = 0;   // Allocated size, counted against the budget
+    };
+
+    explicit SoundPcmCache(size_t budget_bytes);
+    ~SoundPcmCache();
+    SoundPcmCache(const SoundPcmCache&) = delete;
+    SoundPcmCache& operator=(const SoundPcmCache&) = delete;
+
+    void Register(const std::string_view& ogg);
+    bool HasPending() const { return has_pending_; }
+    // Decodes the registered sounds to sample_rate, runs on the decoder task
+    void Fill(int sample_rate);
+    // The returned entry stays valid for the lifetime of the cache. Sounds never registered are not counted,
+    // a sound found counts once the caller reports with CountFound() whether it played the PCM
+    const Entry* Find(const std::string_view& ogg);
+    void CountFound(bool played);
+    SoundPcmCacheStats GetStats();
+
+private:
+    std::mutex mutex_;
+    std::map<const char*, Entry> entries_;
+    std::set<const char*> registered_;
+    std::vector<std::string_view> pending_;
+    std::atomic<bool> has_pending_ = false;
+    size_t budget_bytes_;
+    size_t used_bytes_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+
+    bool Decode(const std::string_view& ogg, int sample_rate, Entry& entry);
+};
+
+#endif // SOUND_PCM_CACHE_H
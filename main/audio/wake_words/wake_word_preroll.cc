@@ -0,0 +1,199 @@
+#include "wake_word_preroll.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#define TAG "WakeWordPreroll"
+
+WakeWordPreroll::WakeWordPreroll() {
+    pcm_ = (int16_t*)heap_caps_malloc(kCapacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    assert(pcm_ != nullptr);
+}
+
+WakeWordPreroll::~WakeWordPreroll() {
+    if (encode_task_ != nullptr) {
+        vTaskDelete(encode_task_);
+    }
+
+    if (encode_task_stack_ != nullptr) {
+        heap_caps_free(encode_task_stack_);
+    }
+
+    if (encode_task_buffer_ != nullptr) {
+        heap_caps_free(encode_task_buffer_);
+    }
+
+    heap_caps_free(pcm_);
+}
+
+void WakeWordPreroll::Store(const int16_t* data, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The stored audio belongs to the detection being encoded, drop the input until it is done
+    if (end_position_ != 0) {
+        return;
+    }
+    if (samples > kCapacity) {
+        data += samples - kCapacity;
+        write_position_ += samples - kCapacity;
+        samples = kCapacity;
+    }
+
+    size_t offset = write_position_ % kCapacity;
+    size_t first = std::min(samples, kCapacity - offset);
+    memcpy(pcm_ + offset, data, first * sizeof(int16_t));
+    memcpy(pcm_, data + first, (samples - first) * sizeof(int16_t));
+    write_position_ += samples;
+
+#if CONFIG_WAKE_WORD_PREROLL_CONTINUOUS_ENCODE
+    if (encode_task_ == nullptr) {
+        StartEncodeTask();
+    } else if (HasWork()) {
+        cv_.notify_all();
+    }
+#endif
+}
+
+void WakeWordPreroll::Encode() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (end_position_ != 0) {
+        return;
+    }
+    output_.clear();
+    if (write_position_ == 0) {
+        output_.push_back(std::vector<uint8_t>());
+        cv_.notify_all();
+        return;
+    }
+    end_position_ = write_position_;
+    if (encode_task_ == nullptr) {
+        StartEncodeTask();
+    }
+    cv_.notify_all();
+}
+
+bool WakeWordPreroll::GetOpus(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() {
+        return !output_.empty();
+    });
+    opus.swap(output_.front());
+    output_.pop_front();
+    return !opus.empty();
+}
+
+void WakeWordPreroll::StartEncodeTask() {
+    const size_t stack_size = 4096 * 7;
+    encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
+    assert(encode_task_stack_ != nullptr);
+    encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    assert(encode_task_buffer_ != nullptr);
+
+    encode_task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (WakeWordPreroll*)arg;
+        this_->EncodeTask();
+        vTaskDelete(NULL);
+    }, "encode_wake_word", stack_size, this, 2, encode_task_stack_, encode_task_buffer_);
+}
+
+uint64_t WakeWordPreroll::FirstFrame(uint64_t end_position) const {
+    // The oldest frame still complete in the buffer
+    if (end_position <= kCapacity) {
+        return 0;
+    }
+    return (end_position - kCapacity + kFrameSamples - 1) / kFrameSamples;
+}
+
+bool WakeWordPreroll::HasWork() const {
+    if (end_position_ != 0) {
+        return true;
+    }
+#if CONFIG_WAKE_WORD_PREROLL_CONTINUOUS_ENCODE
+    return (std::max(next_frame_, FirstFrame(write_position_)) + 1) * kFrameSamples <= write_position_;
+#else
+    return false;
+#endif
+}
+
+void WakeWordPreroll::EncodeTask() {
+    encoder_ = std::make_unique<OpusEncoderWrapper>(WAKE_WORD_PREROLL_SAMPLE_RATE, 1, WAKE_WORD_PREROLL_FRAME_MS);
+    encoder_->SetComplexity(0); // 0 is the fastest
+
+    std::vector<int16_t> frame;
+    std::vector<uint8_t> opus;
+    int64_t detected_time = 0;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() {
+            return HasWork();
+        });
+
+        bool detected = end_position_ != 0;
+        uint64_t end_position = detected ? end_position_ : write_position_;
+        uint64_t first_frame = FirstFrame(end_position);
+        // Frames overwritten before the encoder got to them are skipped
+        while (!encoded_.empty() && encoded_first_frame_ < first_frame) {
+            encoded_.pop_front();
+            encoded_first_frame_++;
+        }
+        if (next_frame_ < first_frame) {
+            next_frame_ = first_frame;
+        }
+
+        if (detected) {
+            if (detected_time == 0) {
+                detected_time = esp_timer_get_time();
+                ESP_LOGI(TAG, "Wake word detected, %u packets encoded in advance", (unsigned)encoded_.size());
+            }
+            for (auto& packet : encoded_) {
+                output_.emplace_back(std::move(packet));
+            }
+            encoded_.clear();
+            if (next_frame_ * kFrameSamples >= end_position) {
+                ESP_LOGI(TAG, "Encode wake word opus %u packets, %ld ms after detection",
+                    (unsigned)(next_frame_ - first_frame), (long)((esp_timer_get_time() - detected_time) / 1000));
+                output_.push_back(std::vector<uint8_t>());
+                cv_.notify_all();
+                // Start over for the next detection
+                write_position_ = 0;
+                next_frame_ = 0;
+                encoded_first_frame_ = 0;
+                end_position_ = 0;
+                detected_time = 0;
+                encoder_->ResetState();
+                continue;
+            }
+            cv_.notify_all();
+        }
+
+        // Copy the frame out of the ring, the last one of a detection is padded with silence
+        uint64_t start = next_frame_ * kFrameSamples;
+        size_t samples = std::min<uint64_t>(kFrameSamples, end_position - start);
+        size_t offset = start % kCapacity;
+        size_t first = std::min(samples, kCapacity - offset);
+        frame.assign(pcm_ + offset, pcm_ + offset + first);
+        frame.insert(frame.end(), pcm_, pcm_ + (samples - first));
+        frame.resize(kFrameSamples, 0);
+        uint64_t frame_index = next_frame_++;
+        lock.unlock();
+
+        opus.clear();
+        bool ok = encoder_->Encode(std::move(frame), opus);
+
+        // Queued in order, the next round hands it out if the wake word was detected meanwhile
+        lock.lock();
+        if (!ok) {
+            ESP_LOGE(TAG, "Failed to encode wake word frame");
+            continue;
+        }
+        if (encoded_.empty()) {
+            encoded_first_frame_ = frame_index;
+        }
+        encoded_.emplace_back(std::move(opus));
+        opus = std::vector<uint8_t>();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef WAKE_WORD_PREROLL_H
+#define WAKE_WORD_PREROLL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+
+#include <opus_encoder.h>
+
+// Audio kept before the wake word, sent to the server for speaker recognition
+#define WAKE_WORD_PREROLL_MS 2000
+#define WAKE_WORD_PREROLL_FRAME_MS 60
+#define WAKE_WORD_PREROLL_SAMPLE_RATE 16000
+
+/*
+ * The audio before and including the wake word, as Opus packets.
+ *
+ * The detection task stores its 16 kHz input into a fixed circular PCM buffer. An encoder
+ * task turns it into Opus frames: with CONFIG_WAKE_WORD_PREROLL_CONTINUOUS_ENCODE it keeps
+ * up with the input while the device is idle, so on detection only the last frame is left
+ * to encode; otherwise it encodes the whole buffer on detection, while the channel opens.
+ *
+ * GetOpus() hands out the packets as soon as they are encoded and returns false after the
+ * last one, the buffer then starts over for the next detection.
+ */
+class WakeWordPreroll {
+public:
+    WakeWordPreroll();
+    ~WakeWordPreroll();
+
+    // Detection task
+    void Store(const int16_t* data, size_t samples);
+    // Called once the wake word is detected, the stored audio up to now is sent
+    void Encode();
+    // Blocks until the next packet is encoded
+    bool GetOpus(std::vector<uint8_t>& opus);
+
+private:
+    static constexpr size_t kFrameSamples = WAKE_WORD_PREROLL_SAMPLE_RATE / 1000 * WAKE_WORD_PREROLL_FRAME_MS;
+    static constexpr size_t kFrameCount = WAKE_WORD_PREROLL_MS / WAKE_WORD_PREROLL_FRAME_MS;
+    static constexpr size_t kCapacity = kFrameSamples * kFrameCount;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // Circular PCM buffer, positions count the samples stored since the last detection
+    int16_t* pcm_ = nullptr;
+    uint64_t write_position_ = 0;
+    // End of the audio to send once detected, 0 while waiting for the wake word
+    uint64_t end_position_ = 0;
+    // Next frame to encode, frames are counted from the start of the positions
+    uint64_t next_frame_ = 0;
+    // Encoded frames not handed out yet, at most the buffer duration
+    std::deque<std::vector<uint8_t>> encoded_;
+    uint64_t encoded_first_frame_ = 0;
+    // Frames handed out by GetOpus(), an empty packet ends them
+    std::deque<std::vector<uint8_t>> output_;
+
+    std::unique_ptr<OpusEncoderWrapper> encoder_;
+    TaskHandle_t encode_task_ = nullptr;
+    StaticTask_t* encode_task_buffer_ = nullptr;
+    StackType_t* encode_task_stack_ = nullptr;
+
+    void StartEncodeTask();
+    void EncodeTask();
+    uint64_t FirstFrame(uint64_t end_position) const;
+    bool HasWork() const;
+};
+
+#endif // WAKE_WORD_PREROLL_H
@@ -1,12 +1,16 @@
 #include "single_led.h"
 #include "application.h"
 #include <esp_log.h> 
+#include <algorithm>
 
 #define TAG "SingleLed"
 
 #define DEFAULT_BRIGHTNESS 4
 #define HIGH_BRIGHTNESS 16
 #define LOW_BRIGHTNESS 2
+// While listening, the red goes from LOW_BRIGHTNESS to HIGH_BRIGHTNESS over this microphone level range
+#define LEVEL_FLOOR_DBFS -60
+#define LEVEL_CEILING_DBFS -20
 
 #define BLINK_INFINITE -1
 
@@ -41,6 +45,7 @@ SingleLed::SingleLed(gpio_num_t gpio) {
 }
 
 SingleLed::~SingleLed() {
+    FollowInputLevel(false);
     esp_timer_stop(blink_timer_);
     if (led_strip_ != nullptr) {
         led_strip_del(led_strip_);
@@ -116,9 +121,38 @@ void SingleLed::OnBlinkTimer() {
 }
 
 
+void SingleLed::FollowInputLevel(bool enable) {
+    auto& meter = Application::GetInstance().GetAudioService().GetLevelMeter();
+    if (enable && level_subscription_ < 0) {
+        level_subscription_ = meter.Subscribe([this](const AudioLevelSnapshot& levels) {
+            OnLevel(levels);
+        });
+    } else if (!enable && level_subscription_ >= 0) {
+        // No callback runs once this returns, so the new state keeps its color
+        meter.Unsubscribe(level_subscription_);
+        level_subscription_ = -1;
+    }
+}
+
+void SingleLed::OnLevel(const AudioLevelSnapshot& levels) {
+    int db = AudioLevelMeter::ToDbfs(levels.input.rms);
+    db = std::max(LEVEL_FLOOR_DBFS, std::min(LEVEL_CEILING_DBFS, db));
+    uint8_t r = LOW_BRIGHTNESS + (HIGH_BRIGHTNESS - LOW_BRIGHTNESS) * (db - LEVEL_FLOOR_DBFS) /
+        (LEVEL_CEILING_DBFS - LEVEL_FLOOR_DBFS);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (r == r_) {
+        return;
+    }
+    r_ = r;
+    led_strip_set_pixel(led_strip_, 0, r_, g_, b_);
+    led_strip_refresh(led_strip_);
+}
+
 void SingleLed::OnStateChanged() {
     auto& app = Application::GetInstance();
     auto device_state = app.GetDeviceState();
+    FollowInputLevel(device_state == kDeviceStateListening || device_state == kDeviceStateAudioTesting);
     switch (device_state) {
         case kDeviceStateStarting:
             SetColor(0, 0, DEFAULT_BRIGHTNESS);
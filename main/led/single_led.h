@@ -8,6 +8,8 @@
 #include <atomic>
 #include <mutex>
 
+struct AudioLevelSnapshot;
+
 class SingleLed : public Led {
 public:
     SingleLed(gpio_num_t gpio);
@@ -23,6 +25,8 @@ private:
     int blink_counter_ = 0;
     int blink_interval_ms_ = 0;
     esp_timer_handle_t blink_timer_ = nullptr;
+    // Level meter subscription while listening, -1 when not subscribed
+    int level_subscription_ = -1;
 
     void StartBlinkTask(int times, int interval_ms);
     void OnBlinkTimer();
@@ -33,6 +37,8 @@ private:
     void TurnOn();
     void TurnOff();
     void SetColor(uint8_t r, uint8_t g, uint8_t b);
+    void FollowInputLevel(bool enable);
+    void OnLevel(const AudioLevelSnapshot& levels);
 };
 
 #endif // _SINGLE_LED_H_
@@ -135,6 +135,34 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.audio.get_latency_stats",
+        "Get the per-stage audio latency (count, p50 / p95 / p99 / max in microseconds) of the uplink and downlink pipeline",
+        PropertyList({
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto& stats = AudioLatencyStats::GetInstance();
+            auto json = stats.GetJson();
+            if (properties["reset"].value<bool>()) {
+                stats.Reset();
+            }
+            return json;
+        });
+
+    AddUserOnlyTool("self.audio.set_frame_duration",
+        "Set the uplink Opus frame duration (20, 40 or 60 ms) offered to the server, used from the next conversation. "
+        "Shorter frames lower the capture latency at the cost of more packets and bandwidth",
+        PropertyList({
+            Property("frame_duration", kPropertyTypeInteger, 20, 60)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            int frame_duration = properties["frame_duration"].value<int>();
+            if (!Application::GetInstance().SetUplinkFrameDuration(frame_duration)) {
+                throw std::runtime_error("Frame duration must be 20, 40 or 60");
+            }
+            return true;
+        });
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
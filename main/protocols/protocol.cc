@@ -4,11 +4,49 @@
 
 #define TAG "Protocol"
 
+AudioPacketPool::AudioPacketPool() : AudioObjectPool<AudioStreamPacket>("Packet", [](AudioStreamPacket& packet) {
+    packet.sample_rate = 0;
+    packet.frame_duration = 0;
+    packet.timestamp = 0;
+    packet.sequence = 0;
+    packet.stage_time_us = 0;
+    // Keep the capacity, the next packet reuses the buffer
+    packet.payload.clear();
+}) {
+}
+
+void Protocol::SetPreferredFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms, keeping %d ms", frame_duration_ms, preferred_frame_duration_);
+        return;
+    }
+    preferred_frame_duration_ = frame_duration_ms;
+}
+
+void Protocol::ParseUplinkFrameDuration(const cJSON* audio_params) {
+    /*
+     * The hello offers our preferred duration in "preferred_uplink_frame_duration", a server that
+     * supports it confirms it with "uplink_frame_duration". Older servers do not reply with it and
+     * get the 60 ms frames the hello announced in "frame_duration".
+     */
+    uplink_frame_duration_ = DEFAULT_UPLINK_FRAME_DURATION_MS;
+    auto uplink_frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+    if (!cJSON_IsNumber(uplink_frame_duration)) {
+        return;
+    }
+    int value = uplink_frame_duration->valueint;
+    if (value == 20 || value == 40 || value == 60) {
+        uplink_frame_duration_ = value;
+    } else {
+        ESP_LOGW(TAG, "Unsupported uplink frame duration %d ms, using %d ms", value, DEFAULT_UPLINK_FRAME_DURATION_MS);
+    }
+}
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
+void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
@@ -7,13 +7,34 @@
 #include <chrono>
 #include <vector>
 
+#include "audio_pool.h"
+
+// Uplink framing of the servers that do not confirm another one in their hello
+#define DEFAULT_UPLINK_FRAME_DURATION_MS 60
+
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;  // 0 if the transport does not number the packets
+    int64_t stage_time_us = 0;  // When the packet entered its pipeline stage, for the latency stats
     std::vector<uint8_t> payload;
 };
 
+// Packets are recycled through AudioPacketPool, a plain std::make_unique packet converts too
+using AudioStreamPacketPtr = AudioPoolPtr<AudioStreamPacket>;
+
+class AudioPacketPool : public AudioObjectPool<AudioStreamPacket> {
+public:
+    static AudioPacketPool& GetInstance() {
+        static AudioPacketPool instance;
+        return instance;
+    }
+
+private:
+    AudioPacketPool();
+};
+
 struct BinaryProtocol2 {
     uint16_t version;
     uint16_t type;          // Message type (0: OPUS, 1: JSON)
@@ -51,11 +72,17 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    // Duration of the uplink Opus frames, as confirmed by the server hello
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
+    // Uplink frame duration offered in the next hello, 20, 40 or 60 ms
+    void SetPreferredFrameDuration(int frame_duration_ms);
+    void OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
@@ -67,7 +94,7 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    virtual bool SendAudio(AudioStreamPacketPtr packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -76,7 +103,7 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
+    std::function<void(AudioStreamPacketPtr packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
@@ -85,6 +112,8 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int preferred_frame_duration_ = DEFAULT_UPLINK_FRAME_DURATION_MS;
+    int uplink_frame_duration_ = DEFAULT_UPLINK_FRAME_DURATION_MS;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
@@ -92,6 +121,7 @@ protected:
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    void ParseUplinkFrameDuration(const cJSON* audio_params);
 };
 
 #endif // PROTOCOL_H
@@ -25,13 +25,14 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool WebsocketProtocol::SendAudio(AudioStreamPacketPtr packet) {
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
+    // Reuse the send buffer, so streaming does not allocate once it has grown to the frame size
+    auto& serialized = send_buffer_;
     if (version_ == 2) {
-        std::string serialized;
         serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
         auto bp2 = (BinaryProtocol2*)serialized.data();
         bp2->version = htons(version_);
@@ -43,7 +44,6 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
 
         return websocket_->Send(serialized.data(), serialized.size(), true);
     } else if (version_ == 3) {
-        std::string serialized;
         serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
         auto bp3 = (BinaryProtocol3*)serialized.data();
         bp3->type = 0;
@@ -118,30 +118,28 @@ bool WebsocketProtocol::OpenAudioChannel() {
                     bp2->timestamp = ntohl(bp2->timestamp);
                     bp2->payload_size = ntohl(bp2->payload_size);
                     auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
+                    auto packet = AudioPacketPool::GetInstance().Acquire();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->timestamp = bp2->timestamp;
+                    packet->payload.assign(payload, payload + bp2->payload_size);
+                    on_incoming_audio_(std::move(packet));
                 } else if (version_ == 3) {
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
                     bp3->type = bp3->type;
                     bp3->payload_size = ntohs(bp3->payload_size);
                     auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
+                    auto packet = AudioPacketPool::GetInstance().Acquire();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->payload.assign(payload, payload + bp3->payload_size);
+                    on_incoming_audio_(std::move(packet));
                 } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
+                    auto packet = AudioPacketPool::GetInstance().Acquire();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->payload.assign((uint8_t*)data, (uint8_t*)data + len);
+                    on_incoming_audio_(std::move(packet));
                 }
             }
         } else {
@@ -215,7 +213,9 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    // The framing sent until the server confirms the preferred one
+    cJSON_AddNumberToObject(audio_params, "frame_duration", DEFAULT_UPLINK_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "preferred_uplink_frame_duration", preferred_frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -238,6 +238,7 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
     }
 
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
+    ParseUplinkFrameDuration(audio_params);
     if (cJSON_IsObject(audio_params)) {
         auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
         if (cJSON_IsNumber(sample_rate)) {
@@ -0,0 +1,447 @@
+/*
+ * Runs AudioService on the host: WAV in -> processor -> Opus encoder -> loopback server
+ * -> jitter buffer -> Opus decoder -> WAV out, then reports throughput, per-stage latency
+ * and queue depths.
+ */
+
+#include "audio_service.h"
+#include "audio_latency.h"
+#include "file_audio_codec.h"
+#include "loopback_protocol.h"
+#include "wav_file.h"
+
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#define REPLAY_POLL_INTERVAL_MS 10
+// The pipeline counts as drained once it stayed idle this long after the input ended
+#define REPLAY_DRAIN_IDLE_MS 300
+#define REPLAY_DRAIN_TIMEOUT_MS 10000
+// --uplink-stall stops sending this far into the replay
+#define REPLAY_UPLINK_STALL_START_MS 1000
+#define REPLAY_SOUND_INTERVAL_MS 1000
+
+struct ReplayOptions {
+    std::string input_path;
+    std::string output_path;
+    std::string json_path;
+    double speed = 1.0;
+    int round_trip_ms = 100;
+    int output_sample_rate = 24000;
+    int frame_duration_ms = 60;
+    int uplink_stall_ms = 0;
+    std::string sound_path;
+    int sound_interval_ms = REPLAY_SOUND_INTERVAL_MS;
+};
+
+struct QueueDepthStats {
+    uint64_t total = 0;
+    uint32_t max = 0;
+
+    void Add(uint32_t depth) {
+        total += depth;
+        max = std::max(max, depth);
+    }
+};
+
+struct ReplayReport {
+    double input_seconds = 0;
+    double output_seconds = 0;
+    double wall_seconds = 0;
+    uint32_t sent_packets = 0;
+    uint32_t received_packets = 0;
+    uint32_t dropped_packets = 0;
+    uint32_t played_sounds = 0;
+    uint32_t depth_samples = 0;
+    QueueDepthStats encode, send, decode, jitter, playback;
+    // Loudest RMS the level subscriber saw per direction, and the updates it got
+    uint16_t input_level = 0;
+    uint16_t output_level = 0;
+    uint32_t level_updates = 0;
+};
+
+// Snapshots of the service components, taken once the service stopped
+struct ServiceStats {
+    OpusEncoderControllerStats encoder;
+    AudioPoolStats packet_pool;
+    AudioSendQueueStats send_queue;
+    JitterBufferStats jitter;
+    AudioTimeStretchStats stretch;
+    AudioDecoderCacheStats decoders;
+    EchoDelayStats echo_delay;
+};
+
+static void PrintUsage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s <input.wav> <output.wav> [options]\n"
+        "  --speed <x>        Playback speed, 1 is real time, 0 runs as fast as possible (default 1)\n"
+        "  --rtt <ms>         Round trip time of the loopback server (default 100)\n"
+        "  --output-rate <hz> Sample rate of the speaker (default 24000)\n"
+        "  --frame <ms>       Uplink frame duration, 20, 40 or 60 (default 60)\n"
+        "  --uplink-stall <ms> Stop sending for this long, 1 s into the replay, to exercise the send queue bound\n"
+        "  --sound <file.ogg> Play this sound every --sound-interval ms of input, over the numbered downlink stream\n"
+        "  --sound-interval <ms> (default 1000)\n"
+        "  --json <path>      Also write the report as JSON\n"
+        "Set HOST_LOG_LEVEL=1..4 to change the log verbosity (default 3, info)\n",
+        name);
+}
+
+static bool ParseOptions(int argc, char** argv, ReplayOptions& options) {
+    if (argc < 3) {
+        return false;
+    }
+    options.input_path = argv[1];
+    options.output_path = argv[2];
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (strcmp(argv[i], "--speed") == 0) {
+            options.speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rtt") == 0) {
+            options.round_trip_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output-rate") == 0) {
+            options.output_sample_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frame") == 0) {
+            options.frame_duration_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--uplink-stall") == 0) {
+            options.uplink_stall_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sound") == 0) {
+            options.sound_path = argv[++i];
+        } else if (strcmp(argv[i], "--sound-interval") == 0) {
+            options.sound_interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            options.json_path = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.speed >= 0 && options.round_trip_ms >= 0 && options.output_sample_rate > 0 &&
+        options.uplink_stall_ms >= 0 && options.sound_interval_ms > 0;
+}
+
+static void PrintReport(const ReplayReport& report, const DebugStatistics& debug, const ServiceStats& service) {
+    printf("Throughput\n");
+    printf("  audio in %.2f s, audio out %.2f s, wall %.2f s, %.2fx real time\n",
+        report.input_seconds, report.output_seconds, report.wall_seconds,
+        report.wall_seconds > 0 ? report.input_seconds / report.wall_seconds : 0);
+    printf("  frames: input %u, encoded %u, decoded %u, played %u\n",
+        debug.input_count, debug.encode_count, debug.decode_count, debug.playback_count);
+    printf("  packets: sent %u, received %u, dropped %u, sounds played %u\n",
+        report.sent_packets, report.received_packets, report.dropped_packets, report.played_sounds);
+
+    printf("Latency (ms)       count      p50      p95      p99      max\n");
+    for (int i = 0; i < kAudioLatencyStageCount; i++) {
+        auto summary = AudioLatencyStats::GetInstance().GetSummary((AudioLatencyStage)i);
+        printf("  %-14s %9u %8.2f %8.2f %8.2f %8.2f\n", AudioLatencyStats::GetStageName((AudioLatencyStage)i), summary.count,
+            summary.p50_us / 1000.0, summary.p95_us / 1000.0, summary.p99_us / 1000.0, summary.max_us / 1000.0);
+    }
+
+    printf("Queue depth        mean      max\n");
+    auto print_depth = [&report](const char* name, const QueueDepthStats& stats) {
+        double mean = report.depth_samples > 0 ? (double)stats.total / report.depth_samples : 0;
+        printf("  %-14s %7.2f %8u\n", name, mean, stats.max);
+    };
+    print_depth("encode", report.encode);
+    print_depth("send", report.send);
+    print_depth("decode", report.decode);
+    print_depth("jitter", report.jitter);
+    print_depth("playback", report.playback);
+
+    printf("Levels: input max %d dBFS, output max %d dBFS, %u updates\n", AudioLevelMeter::ToDbfs(report.input_level),
+        AudioLevelMeter::ToDbfs(report.output_level), report.level_updates);
+
+    const auto& encoder = service.encoder;
+    printf("Encoder: complexity %d, load %u permille, raised %u, dropped %u, congestion %u\n", encoder.complexity,
+        encoder.load_permille, encoder.raises, encoder.drops, encoder.congestion_events);
+
+    const auto& pool = service.packet_pool;
+    printf("Packet pool: capacity %u, peak in use %u, exhausted %u\n", pool.capacity, pool.peak_in_use, pool.exhausted);
+    const auto& send_queue = service.send_queue;
+    printf("Send queue: peak %u ms, dropped %u frames (%u ms, %u ms of voice) in %u congestions, %u overflows\n",
+        send_queue.peak_ms, send_queue.dropped_frames, send_queue.dropped_ms, send_queue.dropped_voice_ms,
+        send_queue.congestions, send_queue.overflows);
+    const auto& jitter = service.jitter;
+    printf("Jitter buffer: target %u frames, jitter %u ms, late %u, concealed %u, underruns %u\n", jitter.target_depth,
+        jitter.jitter_ms, jitter.late_packets, jitter.concealed_frames, jitter.underruns);
+    printf("Catch-up: stretched %u samples, removed %d samples\n", service.stretch.stretched_samples,
+        service.stretch.removed_samples);
+    const auto& decoders = service.decoders;
+    printf("Decoders: %u cached, %u created, %u evicted, %u switches hit the cache\n", decoders.entries,
+        decoders.allocations, decoders.evictions, decoders.hits);
+    const auto& echo_delay = service.echo_delay;
+    printf("Echo delay: %u samples, %u estimates, %u changes, one-tap ERLE %.1f dB (%+.1f dB)\n", echo_delay.delay_samples,
+        echo_delay.estimates, echo_delay.changes, echo_delay.erle_db, echo_delay.erle_gain_db);
+}
+
+static bool WriteJsonReport(const std::string& path, const ReplayReport& report, const DebugStatistics& debug,
+    const ServiceStats& service) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "input_seconds", report.input_seconds);
+    cJSON_AddNumberToObject(root, "output_seconds", report.output_seconds);
+    cJSON_AddNumberToObject(root, "wall_seconds", report.wall_seconds);
+    cJSON_AddNumberToObject(root, "input_frames", debug.input_count);
+    cJSON_AddNumberToObject(root, "encoded_frames", debug.encode_count);
+    cJSON_AddNumberToObject(root, "decoded_frames", debug.decode_count);
+    cJSON_AddNumberToObject(root, "played_frames", debug.playback_count);
+    cJSON_AddNumberToObject(root, "sent_packets", report.sent_packets);
+    cJSON_AddNumberToObject(root, "received_packets", report.received_packets);
+    cJSON_AddNumberToObject(root, "dropped_packets", report.dropped_packets);
+    cJSON_AddNumberToObject(root, "played_sounds", report.played_sounds);
+    cJSON_AddItemToObject(root, "latency", cJSON_Parse(AudioLatencyStats::GetInstance().GetJson().c_str()));
+
+    cJSON* depths = cJSON_CreateObject();
+    auto add_depth = [&report, depths](const char* name, const QueueDepthStats& stats) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "mean", report.depth_samples > 0 ? (double)stats.total / report.depth_samples : 0);
+        cJSON_AddNumberToObject(item, "max", stats.max);
+        cJSON_AddItemToObject(depths, name, item);
+    };
+    add_depth("encode", report.encode);
+    add_depth("send", report.send);
+    add_depth("decode", report.decode);
+    add_depth("jitter", report.jitter);
+    add_depth("playback", report.playback);
+    cJSON_AddItemToObject(root, "queue_depth", depths);
+
+    cJSON* levels = cJSON_CreateObject();
+    cJSON_AddNumberToObject(levels, "input_max_dbfs", AudioLevelMeter::ToDbfs(report.input_level));
+    cJSON_AddNumberToObject(levels, "output_max_dbfs", AudioLevelMeter::ToDbfs(report.output_level));
+    cJSON_AddNumberToObject(levels, "updates", report.level_updates);
+    cJSON_AddItemToObject(root, "levels", levels);
+
+    cJSON* encoder = cJSON_CreateObject();
+    cJSON_AddNumberToObject(encoder, "complexity", service.encoder.complexity);
+    cJSON_AddNumberToObject(encoder, "load_permille", service.encoder.load_permille);
+    cJSON_AddNumberToObject(encoder, "raises", service.encoder.raises);
+    cJSON_AddNumberToObject(encoder, "drops", service.encoder.drops);
+    cJSON_AddNumberToObject(encoder, "congestion_events", service.encoder.congestion_events);
+    cJSON_AddItemToObject(root, "encoder", encoder);
+
+    cJSON* pool = cJSON_CreateObject();
+    cJSON_AddNumberToObject(pool, "capacity", service.packet_pool.capacity);
+    cJSON_AddNumberToObject(pool, "peak_in_use", service.packet_pool.peak_in_use);
+    cJSON_AddNumberToObject(pool, "exhausted", service.packet_pool.exhausted);
+    cJSON_AddItemToObject(root, "packet_pool", pool);
+
+    cJSON* send_queue = cJSON_CreateObject();
+    cJSON_AddNumberToObject(send_queue, "peak_ms", service.send_queue.peak_ms);
+    cJSON_AddNumberToObject(send_queue, "dropped_frames", service.send_queue.dropped_frames);
+    cJSON_AddNumberToObject(send_queue, "dropped_ms", service.send_queue.dropped_ms);
+    cJSON_AddNumberToObject(send_queue, "dropped_voice_ms", service.send_queue.dropped_voice_ms);
+    cJSON_AddNumberToObject(send_queue, "congestions", service.send_queue.congestions);
+    cJSON_AddNumberToObject(send_queue, "overflows", service.send_queue.overflows);
+    cJSON_AddItemToObject(root, "send_queue", send_queue);
+
+    cJSON* jitter = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jitter, "target_depth", service.jitter.target_depth);
+    cJSON_AddNumberToObject(jitter, "jitter_ms", service.jitter.jitter_ms);
+    cJSON_AddNumberToObject(jitter, "late_packets", service.jitter.late_packets);
+    cJSON_AddNumberToObject(jitter, "concealed_frames", service.jitter.concealed_frames);
+    cJSON_AddNumberToObject(jitter, "underruns", service.jitter.underruns);
+    cJSON_AddItemToObject(root, "jitter_buffer", jitter);
+
+    cJSON* catch_up = cJSON_CreateObject();
+    cJSON_AddNumberToObject(catch_up, "stretched_samples", service.stretch.stretched_samples);
+    cJSON_AddNumberToObject(catch_up, "removed_samples", service.stretch.removed_samples);
+    cJSON_AddItemToObject(root, "catch_up", catch_up);
+
+    cJSON* decoders = cJSON_CreateObject();
+    cJSON_AddNumberToObject(decoders, "entries", service.decoders.entries);
+    cJSON_AddNumberToObject(decoders, "allocations", service.decoders.allocations);
+    cJSON_AddNumberToObject(decoders, "evictions", service.decoders.evictions);
+    cJSON_AddNumberToObject(decoders, "hits", service.decoders.hits);
+    cJSON_AddItemToObject(root, "decoders", decoders);
+
+    cJSON* echo_delay = cJSON_CreateObject();
+    cJSON_AddNumberToObject(echo_delay, "delay_samples", service.echo_delay.delay_samples);
+    cJSON_AddNumberToObject(echo_delay, "estimates", service.echo_delay.estimates);
+    cJSON_AddNumberToObject(echo_delay, "changes", service.echo_delay.changes);
+    cJSON_AddNumberToObject(echo_delay, "erle_db", service.echo_delay.erle_db);
+    cJSON_AddNumberToObject(echo_delay, "erle_gain_db", service.echo_delay.erle_gain_db);
+    cJSON_AddItemToObject(root, "echo_delay", echo_delay);
+
+    char* json = cJSON_Print(root);
+    FILE* file = fopen(path.c_str(), "w");
+    bool ok = file != nullptr && fputs(json, file) >= 0;
+    if (file != nullptr) {
+        fclose(file);
+    }
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    WavFile input;
+    if (!input.Read(options.input_path)) {
+        return 1;
+    }
+    // PlaySound takes the OGG file as is, like the sounds embedded in the firmware
+    std::string sound;
+    if (!options.sound_path.empty()) {
+        std::ifstream file(options.sound_path, std::ios::binary);
+        if (!file) {
+            fprintf(stderr, "Failed to open %s\n", options.sound_path.c_str());
+            return 1;
+        }
+        sound.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // Written by the loopback thread, declared first so they outlive it
+    std::atomic<uint32_t> received_packets = 0;
+    std::atomic<uint32_t> dropped_packets = 0;
+
+    FileAudioCodec codec(input, options.output_sample_rate, options.speed);
+    LoopbackProtocol protocol(options.round_trip_ms);
+    // The service tasks are never joined, as on the device, so the service outlives main
+    auto audio_service = new AudioService();
+    ReplayReport report;
+
+    std::mutex mutex;
+    std::condition_variable send_available;
+    bool send_pending = false;
+
+    AudioServiceCallbacks callbacks;
+    callbacks.on_send_queue_available = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        send_pending = true;
+        send_available.notify_one();
+    };
+    audio_service->SetCallbacks(callbacks);
+
+    protocol.OnIncomingAudio([&](AudioStreamPacketPtr packet) {
+        packet->stage_time_us = esp_timer_get_time();
+        received_packets++;
+        if (!audio_service->PushPacketToDecodeQueue(std::move(packet))) {
+            dropped_packets++;
+        }
+    });
+
+    audio_service->Initialize(&codec);
+    // Called from the timer thread until the service stops, the report outlives it
+    int level_subscription = audio_service->GetLevelMeter().Subscribe([&report](const AudioLevelSnapshot& snapshot) {
+        report.input_level = std::max(report.input_level, snapshot.input.rms);
+        report.output_level = std::max(report.output_level, snapshot.output.rms);
+        report.level_updates++;
+    });
+    audio_service->Start();
+    protocol.Start();
+    protocol.OpenAudioChannel();
+    audio_service->SetEncodeFrameDuration(options.frame_duration_ms);
+    audio_service->EnableVoiceProcessing(true);
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t idle_since_us = 0;
+    int64_t input_end_us = 0;
+    int64_t next_sound_ms = options.sound_interval_ms;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            send_available.wait_for(lock, std::chrono::milliseconds(REPLAY_POLL_INTERVAL_MS), [&]() { return send_pending; });
+            send_pending = false;
+        }
+
+        /* Send like the application's main loop does, unless the uplink is stalled */
+        int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+        bool stalled = elapsed_ms >= REPLAY_UPLINK_STALL_START_MS &&
+            elapsed_ms < REPLAY_UPLINK_STALL_START_MS + options.uplink_stall_ms;
+        while (!stalled) {
+            auto packet = audio_service->PopPacketFromSendQueue();
+            if (!packet) {
+                break;
+            }
+            int64_t send_start_us = esp_timer_get_time();
+            protocol.SendAudio(std::move(packet));
+            AudioLatencyStats::GetInstance().RecordSince(kAudioLatencySend, send_start_us);
+        }
+
+        /* Local sounds, in the middle of the numbered loopback stream */
+        int64_t input_ms = (int64_t)codec.input_position() * 1000 / input.channels / input.sample_rate;
+        if (!sound.empty() && input_end_us == 0 && input_ms >= next_sound_ms) {
+            audio_service->PlaySound(sound);
+            report.played_sounds++;
+            next_sound_ms += options.sound_interval_ms;
+        }
+
+        auto depths = audio_service->GetQueueDepths();
+        report.encode.Add(depths.encode);
+        report.send.Add(depths.send);
+        report.decode.Add(depths.decode);
+        report.jitter.Add(depths.jitter);
+        report.playback.Add(depths.playback);
+        report.depth_samples++;
+
+        int64_t now_us = esp_timer_get_time();
+        if (input_end_us == 0) {
+            if (codec.input_finished()) {
+                input_end_us = now_us;
+                audio_service->EnableVoiceProcessing(false);
+            }
+            continue;
+        }
+
+        /* Wait until everything sent has come back and been played */
+        if (protocol.pending() == 0 && audio_service->IsIdle()) {
+            if (idle_since_us == 0) {
+                idle_since_us = now_us;
+            } else if (now_us - idle_since_us >= REPLAY_DRAIN_IDLE_MS * 1000) {
+                break;
+            }
+        } else {
+            idle_since_us = 0;
+        }
+        if (now_us - input_end_us >= REPLAY_DRAIN_TIMEOUT_MS * 1000) {
+            fprintf(stderr, "The pipeline did not drain within %d ms\n", REPLAY_DRAIN_TIMEOUT_MS);
+            break;
+        }
+    }
+
+    audio_service->GetLevelMeter().Unsubscribe(level_subscription);
+    audio_service->Stop();
+    report.wall_seconds = (esp_timer_get_time() - start_us) / 1000000.0;
+    report.sent_packets = protocol.sent_packets();
+    report.received_packets = received_packets;
+    report.dropped_packets = dropped_packets;
+    report.input_seconds = (double)codec.input_position() / input.channels / input.sample_rate;
+
+    auto output = codec.TakeOutput();
+    report.output_seconds = (double)output.samples.size() / output.sample_rate;
+    if (!output.Write(options.output_path)) {
+        return 1;
+    }
+
+    const auto& debug = audio_service->GetDebugStatistics();
+    ServiceStats service;
+    service.encoder = audio_service->GetEncoderControllerStats();
+    service.packet_pool = AudioPacketPool::GetInstance().GetStats();
+    service.send_queue = audio_service->GetSendQueueStats();
+    service.jitter = audio_service->GetJitterBufferStats();
+    service.stretch = audio_service->GetTimeStretchStats();
+    service.decoders = audio_service->GetDecoderCacheStats();
+    service.echo_delay = audio_service->GetEchoDelayStats();
+    PrintReport(report, debug, service);
+    if (!options.json_path.empty() && !WriteJsonReport(options.json_path, report, debug, service)) {
+        fprintf(stderr, "Failed to write %s\n", options.json_path.c_str());
+        return 1;
+    }
+    return 0;
+}
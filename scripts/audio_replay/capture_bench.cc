@@ -0,0 +1,225 @@
+/*
+ * Compares the capture stage of AudioService::ReadAudioData before and after it moved to
+ * scratch buffers: the per-frame vectors with the scalar deinterleave / interleave loops,
+ * against the persistent buffers with the audio_dsp.h kernels. Both resample with
+ * AudioResampler, the "resample" row is the resampling alone, the floor of both paths.
+ */
+
+#include "audio_dsp.h"
+#include "audio_resampler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_FEED_SAMPLES 512     // The AFE feed size at 16 kHz, what the input task reads per call
+#define BENCH_OUTPUT_RATE 16000
+#define BENCH_SECONDS 20
+
+// Counts the heap allocations, the old path made four per stereo frame
+static std::atomic<uint64_t> allocations = 0;
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const int kInputRates[] = {48000, 44100, 24000};
+
+struct BenchResult {
+    double us_per_second = 0;
+    double cycles_per_second = 0;
+    double allocations_per_frame = 0;
+    std::vector<int16_t> last_frame;
+};
+
+static uint64_t ReadCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Stands in for AudioCodec::InputData, the I2S read fills the buffer it is given
+struct FakeCodec {
+    const std::vector<int16_t>& source;
+    size_t offset = 0;
+
+    void InputData(std::vector<int16_t>& data) {
+        if (offset + data.size() > source.size()) {
+            offset = 0;
+        }
+        memcpy(data.data(), source.data() + offset, data.size() * sizeof(int16_t));
+        offset += data.size();
+    }
+};
+
+struct CaptureState {
+    int input_rate;
+    int channels;
+    AudioResampler input_resampler;
+    AudioResampler reference_resampler;
+    std::vector<int16_t> capture_buffer;
+    std::vector<int16_t> capture_planar_buffer;
+
+    CaptureState(int input_rate, int channels) : input_rate(input_rate), channels(channels) {
+        input_resampler.Configure(input_rate, BENCH_OUTPUT_RATE);
+        reference_resampler.Configure(input_rate, BENCH_OUTPUT_RATE);
+    }
+};
+
+// ReadAudioData as it was: a new vector per call and four temporaries per stereo frame
+static void CaptureBefore(CaptureState& state, FakeCodec& codec, std::vector<int16_t>& data, int samples) {
+    data.resize(samples * state.input_rate / BENCH_OUTPUT_RATE * state.channels);
+    codec.InputData(data);
+    if (state.channels == 2) {
+        auto mic_channel = std::vector<int16_t>(data.size() / 2);
+        auto reference_channel = std::vector<int16_t>(data.size() / 2);
+        for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+            mic_channel[i] = data[j];
+            reference_channel[i] = data[j + 1];
+        }
+        auto resampled_mic = std::vector<int16_t>(state.input_resampler.GetOutputSamples(mic_channel.size()));
+        auto resampled_reference = std::vector<int16_t>(state.reference_resampler.GetOutputSamples(reference_channel.size()));
+        state.input_resampler.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
+        state.reference_resampler.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
+        data.resize(resampled_mic.size() + resampled_reference.size());
+        for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+            data[j] = resampled_mic[i];
+            data[j + 1] = resampled_reference[i];
+        }
+    } else {
+        auto resampled = std::vector<int16_t>(state.input_resampler.GetOutputSamples(data.size()));
+        state.input_resampler.Process(data.data(), data.size(), resampled.data());
+        data = std::move(resampled);
+    }
+}
+
+// ReadAudioData now: the scratch buffers of the input task and the word-wise kernels
+static void CaptureAfter(CaptureState& state, FakeCodec& codec, std::vector<int16_t>& data, int samples) {
+    auto& raw = state.capture_buffer;
+    raw.resize(samples * state.input_rate / BENCH_OUTPUT_RATE * state.channels);
+    codec.InputData(raw);
+    if (state.channels == 2) {
+        size_t frames = raw.size() / 2;
+        state.capture_planar_buffer.resize(raw.size());
+        int16_t* mic = state.capture_planar_buffer.data();
+        int16_t* reference = mic + frames;
+        AudioDeinterleave(raw.data(), frames, mic, reference);
+
+        size_t resampled_frames = state.input_resampler.GetOutputSamples(frames);
+        raw.resize(resampled_frames * 2);
+        state.input_resampler.Process(mic, frames, raw.data());
+        state.reference_resampler.Process(reference, frames, raw.data() + resampled_frames);
+        data.resize(resampled_frames * 2);
+        AudioInterleave(raw.data(), raw.data() + resampled_frames, resampled_frames, data.data());
+    } else {
+        data.resize(state.input_resampler.GetOutputSamples(raw.size()));
+        state.input_resampler.Process(raw.data(), raw.size(), data.data());
+    }
+}
+
+// The resamplers alone on planar input, into buffers sized up front
+static void ResampleOnly(CaptureState& state, FakeCodec& codec, std::vector<int16_t>& data, int samples) {
+    auto& planar = state.capture_planar_buffer;
+    size_t frames = samples * state.input_rate / BENCH_OUTPUT_RATE;
+    planar.resize(frames * state.channels);
+    codec.InputData(planar);
+    size_t resampled_frames = state.input_resampler.GetOutputSamples(frames);
+    data.resize(resampled_frames * state.channels);
+    state.input_resampler.Process(planar.data(), frames, data.data());
+    if (state.channels == 2) {
+        state.reference_resampler.Process(planar.data() + frames, frames, data.data() + resampled_frames);
+    }
+}
+
+template <typename Capture>
+static BenchResult Bench(int input_rate, int channels, const std::vector<int16_t>& source, bool vector_per_frame,
+    Capture capture) {
+    BenchResult result;
+    CaptureState state(input_rate, channels);
+    FakeCodec codec{source};
+    const int frames = BENCH_SECONDS * BENCH_OUTPUT_RATE / BENCH_FEED_SAMPLES;
+
+    // The input task used to declare the vector in its loop, it keeps one now
+    std::vector<int16_t> data;
+    uint64_t start_allocations = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = ReadCycles();
+    for (int i = 0; i < frames; i++) {
+        if (vector_per_frame) {
+            std::vector<int16_t> frame_data;
+            capture(state, codec, frame_data, BENCH_FEED_SAMPLES);
+            if (i == frames - 1) {
+                result.last_frame = std::move(frame_data);
+            }
+        } else {
+            capture(state, codec, data, BENCH_FEED_SAMPLES);
+        }
+    }
+    uint64_t cycles = ReadCycles() - start_cycles;
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    // Before the copy of the last frame below, which would count as one
+    result.allocations_per_frame = (double)(allocations.load() - start_allocations) / frames;
+    if (!vector_per_frame) {
+        result.last_frame = data;
+    }
+    result.us_per_second = elapsed / BENCH_SECONDS;
+    result.cycles_per_second = (double)cycles / BENCH_SECONDS;
+    return result;
+}
+
+static void Print(const char* name, const BenchResult& result) {
+    printf("  %-10s %10.1f %12.0f %10.2f\n", name, result.us_per_second, result.cycles_per_second,
+        result.allocations_per_frame);
+}
+
+int main() {
+    bool identical = true;
+    for (int input_rate : kInputRates) {
+        for (int channels = 1; channels <= 2; channels++) {
+            // Speech-like noise, the reference channel different from the mic
+            std::vector<int16_t> source(input_rate * channels);
+            uint32_t seed = 1;
+            for (auto& sample : source) {
+                seed = seed * 1664525 + 1013904223;
+                sample = (int16_t)((int32_t)(seed >> 16) - 32768) / 4;
+            }
+
+            printf("%d Hz %s -> %d Hz, %d samples per read\n", input_rate, channels == 2 ? "stereo" : "mono",
+                BENCH_OUTPUT_RATE, BENCH_FEED_SAMPLES);
+            printf("  %-10s %10s %12s %10s\n", "path", "us/s", "cycles/s", "allocs");
+            auto before = Bench(input_rate, channels, source, true, CaptureBefore);
+            auto after = Bench(input_rate, channels, source, false, CaptureAfter);
+            auto floor = Bench(input_rate, channels, source, false, ResampleOnly);
+            Print("before", before);
+            Print("after", after);
+            Print("resample", floor);
+            if (before.last_frame != after.last_frame) {
+                printf("  the two paths disagree\n");
+                identical = false;
+            }
+        }
+    }
+    return identical ? 0 : 1;
+}
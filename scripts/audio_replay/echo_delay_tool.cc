@@ -0,0 +1,101 @@
+/*
+ * Runs EchoDelayEstimator offline on a recording: a stereo WAV with the microphone in the
+ * first channel and the playback reference in the second, as the codec captures them, or a
+ * microphone WAV and a reference WAV. Prints each change of the estimate and the result, and
+ * can write the recording back with the reference compensated.
+ */
+
+#include "echo_delay_estimator.h"
+#include "wav_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define TOOL_BLOCK_MS 30
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Usage: %s <capture.wav> [reference.wav] [--aligned <output.wav>]\n", program);
+    fprintf(stderr, "  capture.wav     Stereo microphone + reference, or the microphone alone with reference.wav\n");
+    fprintf(stderr, "  --aligned <p>   Write the stereo recording with the reference delayed by the estimate\n");
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> inputs;
+    std::string aligned_path;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--aligned") == 0 && i + 1 < argc) {
+            aligned_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            PrintUsage(argv[0]);
+            return 1;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty() || inputs.size() > 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    WavFile capture;
+    if (!capture.Read(inputs[0])) {
+        fprintf(stderr, "Failed to read %s\n", inputs[0].c_str());
+        return 1;
+    }
+    WavFile stereo;
+    stereo.sample_rate = capture.sample_rate;
+    stereo.channels = 2;
+    if (inputs.size() == 2) {
+        WavFile reference;
+        if (!reference.Read(inputs[1])) {
+            fprintf(stderr, "Failed to read %s\n", inputs[1].c_str());
+            return 1;
+        }
+        if (capture.channels != 1 || reference.channels != 1 || reference.sample_rate != capture.sample_rate) {
+            fprintf(stderr, "The microphone and reference files must be mono at the same sample rate\n");
+            return 1;
+        }
+        size_t frames = std::min(capture.samples.size(), reference.samples.size());
+        stereo.samples.resize(frames * 2);
+        for (size_t i = 0; i < frames; i++) {
+            stereo.samples[i * 2] = capture.samples[i];
+            stereo.samples[i * 2 + 1] = reference.samples[i];
+        }
+    } else if (capture.channels == 2) {
+        stereo.samples = std::move(capture.samples);
+    } else {
+        fprintf(stderr, "A mono capture needs the reference file\n");
+        return 1;
+    }
+
+    EchoDelayEstimator estimator;
+    estimator.Configure(stereo.sample_rate);
+    const size_t block = stereo.sample_rate * TOOL_BLOCK_MS / 1000;
+    const size_t frames = stereo.samples.size() / 2;
+    uint32_t changes = 0;
+    for (size_t offset = 0; offset < frames; offset += block) {
+        size_t count = std::min(block, frames - offset);
+        estimator.Process(stereo.samples.data() + offset * 2, count, 2);
+        auto stats = estimator.GetStats();
+        if (stats.changes != changes) {
+            changes = stats.changes;
+            printf("%8.2f s  delay %7.2f ms  correlation %.2f  ERLE %5.1f dB (%+.1f dB)\n",
+                (double)(offset + count) / stereo.sample_rate, stats.delay_samples * 1000.0 / stereo.sample_rate,
+                stats.correlation, stats.erle_db, stats.erle_gain_db);
+        }
+    }
+
+    auto stats = estimator.GetStats();
+    printf("Echo delay: %.2f ms (%u samples), %u trusted estimates, %u changes\n",
+        stats.delay_samples * 1000.0 / stereo.sample_rate, stats.delay_samples, stats.estimates, stats.changes);
+    printf("One-tap ERLE: %.1f dB at the delay, %+.1f dB over no compensation\n", stats.erle_db, stats.erle_gain_db);
+
+    if (!aligned_path.empty() && !stereo.Write(aligned_path)) {
+        fprintf(stderr, "Failed to write %s\n", aligned_path.c_str());
+        return 1;
+    }
+    return stats.estimates > 0 ? 0 : 2;
+}
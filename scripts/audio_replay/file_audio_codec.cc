@@ -0,0 +1,88 @@
+#include "file_audio_codec.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <thread>
+#include <cstring>
+
+FileAudioCodec::FileAudioCodec(const WavFile& input, int output_sample_rate, double speed)
+    : input_(input), speed_(speed) {
+    duplex_ = true;
+    // A stereo file is the microphone with the playback reference in the second channel
+    input_reference_ = input.channels == 2;
+    input_channels_ = input.channels;
+    input_sample_rate_ = input.sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    output_.sample_rate = output_sample_rate;
+    output_.channels = 1;
+}
+
+std::chrono::steady_clock::duration FileAudioCodec::ToWallTime(size_t frames, int sample_rate) const {
+    auto media = std::chrono::duration<double>((double)frames / sample_rate / speed_);
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(media);
+}
+
+int FileAudioCodec::Read(int16_t* dest, int samples) {
+    if (input_frames_read_ == 0) {
+        input_start_ = std::chrono::steady_clock::now();
+    }
+    input_frames_read_ += samples / input_channels_;
+    if (speed_ > 0) {
+        std::this_thread::sleep_until(input_start_ + ToWallTime(input_frames_read_, input_sample_rate_));
+    }
+
+    size_t position = input_position_;
+    size_t count = std::min<size_t>(samples, input_.samples.size() - position);
+    memcpy(dest, input_.samples.data() + position, count * sizeof(int16_t));
+    memset(dest + count, 0, (samples - count) * sizeof(int16_t));
+    input_position_ = position + count;
+    if (position + count >= input_.samples.size()) {
+        input_finished_ = true;
+    }
+    return samples;
+}
+
+int FileAudioCodec::Write(const int16_t* data, int samples) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point dma_end;
+    std::unique_lock<std::mutex> lock(output_mutex_);
+    if (speed_ > 0) {
+        if (!output_started_ || output_end_ < now) {
+            // The DMA ran dry, the speaker played silence in the meantime
+            if (output_started_) {
+                auto gap = std::chrono::duration<double>(now - output_end_).count() * speed_;
+                output_.samples.resize(output_.samples.size() + (size_t)(gap * output_sample_rate_), 0);
+            }
+            output_end_ = now;
+        }
+        output_end_ += ToWallTime(samples, output_sample_rate_);
+        dma_end = output_end_ - ToWallTime(AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM, output_sample_rate_);
+    }
+    output_started_ = true;
+    output_.samples.insert(output_.samples.end(), data, data + samples);
+    lock.unlock();
+
+    // Like i2s_channel_write, return once the data fits in the DMA buffer
+    if (speed_ > 0) {
+        std::this_thread::sleep_until(dma_end);
+    }
+    return samples;
+}
+
+uint64_t FileAudioCodec::GetOutputPosition(int64_t time_us) {
+    uint64_t written = output_written_frames();
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (speed_ <= 0 || !output_started_) {
+        return written;
+    }
+    // The frames due after time_us are still in the DMA buffer
+    auto time = std::chrono::steady_clock::now() + std::chrono::microseconds(time_us - esp_timer_get_time());
+    double pending = std::chrono::duration<double>(output_end_ - time).count() * speed_ * output_sample_rate_;
+    return written - std::min<uint64_t>(written, (uint64_t)std::max(0.0, pending));
+}
+
+WavFile FileAudioCodec::TakeOutput() {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    return std::move(output_);
+}
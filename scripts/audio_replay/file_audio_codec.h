@@ -0,0 +1,49 @@
+#ifndef FILE_AUDIO_CODEC_H
+#define FILE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+#include "wav_file.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+/*
+ * An AudioCodec that captures from a WAV file and plays into a WAV file.
+ *
+ * With a speed above zero the reads and writes are paced like I2S: reads block until the
+ * samples would have been captured, writes block while the DMA buffer is full, and gaps
+ * in the playback are written as silence. With speed 0 the codec never blocks, so the
+ * pipeline runs as fast as the tasks can go.
+ */
+class FileAudioCodec : public AudioCodec {
+public:
+    FileAudioCodec(const WavFile& input, int output_sample_rate, double speed);
+
+    bool input_finished() const { return input_finished_; }
+    // Samples captured from the file, the silence read after its end is not counted
+    size_t input_position() const { return input_position_; }
+    WavFile TakeOutput();
+    // No DMA interrupt here, the position follows the pacing of the writes
+    virtual uint64_t GetOutputPosition(int64_t time_us) override;
+
+private:
+    const WavFile& input_;
+    double speed_;
+    std::atomic<size_t> input_position_ = 0;
+    std::atomic<bool> input_finished_ = false;
+    std::chrono::steady_clock::time_point input_start_;
+    size_t input_frames_read_ = 0;
+
+    std::mutex output_mutex_;
+    WavFile output_;
+    bool output_started_ = false;
+    // When the samples written so far will have left the DMA buffer
+    std::chrono::steady_clock::time_point output_end_;
+
+    std::chrono::steady_clock::duration ToWallTime(size_t frames, int sample_rate) const;
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+};
+
+#endif // FILE_AUDIO_CODEC_H
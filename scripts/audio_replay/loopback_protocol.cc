@@ -0,0 +1,76 @@
+#include "loopback_protocol.h"
+
+LoopbackProtocol::LoopbackProtocol(int round_trip_ms) : round_trip_(round_trip_ms) {
+    server_sample_rate_ = 16000;
+    server_frame_duration_ = 60;
+    thread_ = std::thread(&LoopbackProtocol::ReturnTask, this);
+}
+
+LoopbackProtocol::~LoopbackProtocol() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+bool LoopbackProtocol::Start() {
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+bool LoopbackProtocol::OpenAudioChannel() {
+    channel_opened_ = true;
+    if (on_audio_channel_opened_) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+void LoopbackProtocol::CloseAudioChannel() {
+    channel_opened_ = false;
+    if (on_audio_channel_closed_) {
+        on_audio_channel_closed_();
+    }
+}
+
+bool LoopbackProtocol::SendAudio(AudioStreamPacketPtr packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    packet->sequence = next_sequence_++;
+    pending_.push_back({std::chrono::steady_clock::now() + round_trip_, std::move(packet)});
+    sent_packets_++;
+    cv_.notify_all();
+    return true;
+}
+
+size_t LoopbackProtocol::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+void LoopbackProtocol::ReturnTask() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopped_) {
+        if (pending_.empty()) {
+            cv_.wait(lock);
+            continue;
+        }
+        if (cv_.wait_until(lock, pending_.front().due, [this]() { return stopped_; })) {
+            break;
+        }
+        if (std::chrono::steady_clock::now() < pending_.front().due) {
+            continue;
+        }
+        auto packet = std::move(pending_.front().packet);
+        pending_.pop_front();
+        // The receiver may send again, so it is called unlocked
+        lock.unlock();
+        if (on_incoming_audio_) {
+            on_incoming_audio_(std::move(packet));
+        }
+        lock.lock();
+    }
+}
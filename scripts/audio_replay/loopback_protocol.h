@@ -0,0 +1,52 @@
+#ifndef LOOPBACK_PROTOCOL_H
+#define LOOPBACK_PROTOCOL_H
+
+#include "protocol.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+/*
+ * A server stand-in that sends every uplink packet back as downlink audio after a fixed
+ * round trip time, numbered like a server that uses sequence numbers.
+ */
+class LoopbackProtocol : public Protocol {
+public:
+    explicit LoopbackProtocol(int round_trip_ms);
+    ~LoopbackProtocol();
+
+    bool Start() override;
+    bool OpenAudioChannel() override;
+    void CloseAudioChannel() override;
+    bool IsAudioChannelOpened() const override { return channel_opened_; }
+    bool SendAudio(AudioStreamPacketPtr packet) override;
+
+    // Packets sent and not returned yet
+    size_t pending() const;
+    uint32_t sent_packets() const { return sent_packets_; }
+
+private:
+    struct PendingPacket {
+        std::chrono::steady_clock::time_point due;
+        AudioStreamPacketPtr packet;
+    };
+
+    std::chrono::milliseconds round_trip_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<PendingPacket> pending_;
+    std::thread thread_;
+    bool stopped_ = false;
+    std::atomic<bool> channel_opened_ = false;
+    std::atomic<uint32_t> sent_packets_ = 0;
+    uint32_t next_sequence_ = 1;
+
+    bool SendText(const std::string& text) override { return true; }
+    void ReturnTask();
+};
+
+#endif // LOOPBACK_PROTOCOL_H
@@ -0,0 +1,516 @@
+/*
+ * Stress benchmark of the AudioService queues: the std::deque queues behind one mutex and one
+ * shared condition variable that the service used before, against the AudioRingQueue rings
+ * with a wake-up event per consumer. Both run the same pipeline, paced like the device:
+ *
+ *   input ---> encode queue ---> codec task ---> send queue ---> sender (main loop)
+ *   network -> decode queue ---> codec task ---> playback queue -> output
+ *
+ * The codec task spins for the encode and decode time of each frame, the output blocks for a
+ * frame period per write like I2S with two DMA buffers. All threads are pinned to --cores
+ * cores, with --load extra busy threads competing for them. Reports:
+ *
+ * - lock wait: the time to acquire the shared mutex, for the mutex design only: the rings take
+ *   no lock on their push / pop path.
+ * - queue op: the time in the queue calls of both designs, lock, queue work and the wake-up
+ *   of the other side, without the sleeps for data or room.
+ * - capture jitter: how late the input task gets back to capturing after pushing a frame.
+ * - playback jitter: how long the speaker ran dry before each frame reached it.
+ */
+
+#include "audio_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define BENCH_ENCODE_TASKS 2
+#define BENCH_DECODE_PACKETS 40
+#define BENCH_SEND_PACKETS 40
+#define BENCH_PLAYBACK_TASKS 2
+
+struct BenchOptions {
+    int period_us = 10000;      // 60 ms frames scaled down, the ratios to the work stay
+    int encode_us = 2500;
+    int decode_us = 1500;
+    int seconds = 10;
+    int cores = 2;
+    int load = 1;
+};
+
+struct Frame {
+    std::vector<int16_t> pcm;
+};
+using FramePtr = std::unique_ptr<Frame>;
+
+static int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Spin(int us) {
+    int64_t end = NowUs() + us;
+    while (NowUs() < end) {
+    }
+}
+
+static void SleepUntil(int64_t time_us) {
+    int64_t now = NowUs();
+    if (time_us > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds(time_us - now));
+    }
+}
+
+static void PinThread(int cores) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < cores; i++) {
+        CPU_SET(i, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// Samples of one thread, summarized once the threads are joined
+struct Samples {
+    std::vector<int64_t> values;
+    void Add(int64_t value) { values.push_back(value); }
+};
+
+// What one thread measures in the queue calls
+struct Probe {
+    Samples lock;       // Acquiring the shared mutex
+    Samples op;         // In the call, without the sleeps for data or room: lock, queue work and wake-ups
+};
+
+struct Summary {
+    size_t count = 0;
+    double total_ms = 0;
+    int64_t p50 = 0, p99 = 0, max = 0;
+};
+
+static Summary Summarize(std::vector<const Samples*> parts) {
+    std::vector<int64_t> all;
+    for (auto part : parts) {
+        all.insert(all.end(), part->values.begin(), part->values.end());
+    }
+    Summary summary;
+    if (all.empty()) {
+        return summary;
+    }
+    std::sort(all.begin(), all.end());
+    summary.count = all.size();
+    for (auto value : all) {
+        summary.total_ms += value / 1000.0;
+    }
+    summary.p50 = all[all.size() / 2];
+    summary.p99 = all[std::min(all.size() - 1, all.size() * 99 / 100)];
+    summary.max = all.back();
+    return summary;
+}
+
+/* The queues as they were: one mutex and one condition variable for everything */
+class MutexQueues {
+public:
+    void PushEncode(FramePtr frame, Probe& probe) {
+        Op op(this, probe);
+        op.Wait([this]() { return stopped_ || encode_.size() < BENCH_ENCODE_TASKS; });
+        encode_.push_back(std::move(frame));
+        cv_.notify_all();
+    }
+
+    bool PushDecode(FramePtr frame, Probe& probe) {
+        Op op(this, probe);
+        if (decode_.size() >= BENCH_DECODE_PACKETS) {
+            return false;
+        }
+        decode_.push_back(std::move(frame));
+        cv_.notify_all();
+        return true;
+    }
+
+    // The codec task: decodes first, then encodes, as the service did
+    bool CodecStep(const BenchOptions& options, Probe& probe, const std::function<void()>& on_send) {
+        FramePtr decode, encode;
+        {
+            Op op(this, probe);
+            op.Wait([this]() {
+                return stopped_ || (!encode_.empty() && send_.size() < BENCH_SEND_PACKETS) ||
+                    (!decode_.empty() && playback_.size() < BENCH_PLAYBACK_TASKS);
+            });
+            if (stopped_) {
+                return false;
+            }
+            if (!decode_.empty() && playback_.size() < BENCH_PLAYBACK_TASKS) {
+                decode = std::move(decode_.front());
+                decode_.pop_front();
+                cv_.notify_all();
+            }
+        }
+        if (decode) {
+            Spin(options.decode_us);
+            Op op(this, probe);
+            playback_.push_back(std::move(decode));
+            cv_.notify_all();
+        }
+        {
+            Op op(this, probe);
+            if (!encode_.empty() && send_.size() < BENCH_SEND_PACKETS) {
+                encode = std::move(encode_.front());
+                encode_.pop_front();
+                cv_.notify_all();
+            }
+        }
+        if (encode) {
+            Spin(options.encode_us);
+            {
+                Op op(this, probe);
+                send_.push_back(std::move(encode));
+            }
+            on_send();
+        }
+        return true;
+    }
+
+    FramePtr PopSend(Probe& probe) {
+        Op op(this, probe);
+        if (send_.empty()) {
+            return nullptr;
+        }
+        auto frame = std::move(send_.front());
+        send_.pop_front();
+        cv_.notify_all();
+        return frame;
+    }
+
+    FramePtr PopPlayback(Probe& probe) {
+        Op op(this, probe);
+        op.Wait([this]() { return stopped_ || !playback_.empty(); });
+        if (stopped_) {
+            return nullptr;
+        }
+        auto frame = std::move(playback_.front());
+        playback_.pop_front();
+        cv_.notify_all();
+        return frame;
+    }
+
+    void Stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<FramePtr> encode_, decode_, send_, playback_;
+    bool stopped_ = false;
+
+    // Holds the mutex for a call and times it, leaving out the sleep in Wait()
+    class Op {
+    public:
+        Op(MutexQueues* queues, Probe& probe) : queues_(queues), probe_(probe), start_(NowUs()), lock_(queues->mutex_) {
+            probe_.lock.Add(NowUs() - start_);
+        }
+        ~Op() {
+            lock_.unlock();
+            probe_.op.Add(NowUs() - start_ - slept_);
+        }
+        template <typename Predicate>
+        void Wait(Predicate ready) {
+            if (ready()) {
+                return;
+            }
+            int64_t sleep_start = NowUs();
+            queues_->cv_.wait(lock_, ready);
+            // Getting the mutex back after the wake-up is lock wait too, but cannot be told apart here
+            slept_ += NowUs() - sleep_start;
+        }
+
+    private:
+        MutexQueues* queues_;
+        Probe& probe_;
+        int64_t start_;
+        int64_t slept_ = 0;
+        std::unique_lock<std::mutex> lock_;
+    };
+};
+
+/* The rings, wired like AudioService: the codec task sleeps on one event, the output on another */
+class RingQueues {
+public:
+    RingQueues()
+        : encode_(BENCH_ENCODE_TASKS, &codec_event_, &encode_writable_event_),
+          decode_(BENCH_DECODE_PACKETS, &codec_event_, nullptr),
+          send_(BENCH_SEND_PACKETS, nullptr, &codec_event_),
+          playback_(BENCH_PLAYBACK_TASKS, &playback_event_, &codec_event_) {
+    }
+
+    // No lock on the push / pop path, only the op time is measured
+    void PushEncode(FramePtr frame, Probe& probe) {
+        encode_writable_event_.Wait([this]() { return stopped_ || !encode_.full(); });
+        Timed(probe, [&]() { return encode_.TryPush(std::move(frame)); });
+    }
+
+    bool PushDecode(FramePtr frame, Probe& probe) {
+        return Timed(probe, [&]() { return decode_.TryPush(std::move(frame)); });
+    }
+
+    bool CodecStep(const BenchOptions& options, Probe& probe, const std::function<void()>& on_send) {
+        codec_event_.Wait([this]() {
+            return stopped_ || (encode_.readable() && !send_.full()) || (decode_.readable() && !playback_.full());
+        });
+        if (stopped_) {
+            return false;
+        }
+        FramePtr frame;
+        if (!playback_.full() && Timed(probe, [&]() { return decode_.Pop(frame); })) {
+            Spin(options.decode_us);
+            Timed(probe, [&]() { return playback_.TryPush(std::move(frame)); });
+        }
+        if (!send_.full() && Timed(probe, [&]() { return encode_.Pop(frame); })) {
+            Spin(options.encode_us);
+            Timed(probe, [&]() { return send_.TryPush(std::move(frame)); });
+            on_send();
+        }
+        return true;
+    }
+
+    FramePtr PopSend(Probe& probe) {
+        FramePtr frame;
+        Timed(probe, [&]() { return send_.Pop(frame); });
+        return frame;
+    }
+
+    FramePtr PopPlayback(Probe& probe) {
+        playback_event_.Wait([this]() { return stopped_ || playback_.readable(); });
+        FramePtr frame;
+        if (!stopped_) {
+            Timed(probe, [&]() { return playback_.Pop(frame); });
+        }
+        return frame;
+    }
+
+    void Stop() {
+        stopped_ = true;
+        codec_event_.Notify();
+        playback_event_.Notify();
+        encode_writable_event_.Notify();
+    }
+
+private:
+    AudioQueueEvent codec_event_;
+    AudioQueueEvent playback_event_;
+    AudioQueueEvent encode_writable_event_;
+    AudioRingQueue<FramePtr> encode_, decode_, send_, playback_;
+    std::atomic<bool> stopped_ = false;
+
+    template <typename F>
+    static bool Timed(Probe& probe, F operation) {
+        int64_t start = NowUs();
+        bool result = operation();
+        probe.op.Add(NowUs() - start);
+        return result;
+    }
+};
+
+struct BenchResult {
+    Summary lock_wait;
+    Summary queue_op;
+    Summary capture_jitter;
+    Summary playback_jitter;
+    uint32_t sent = 0;
+    uint32_t played = 0;
+    uint32_t dropped = 0;
+};
+
+template <typename Queues>
+static BenchResult RunPipeline(const BenchOptions& options) {
+    Queues queues;
+    std::atomic<bool> running = true;
+    Probe input_probe, network_probe, codec_probe, sender_probe, output_probe;
+    Samples capture_jitter, playback_jitter;
+    std::atomic<uint32_t> sent = 0, played = 0, dropped = 0;
+    const int64_t start_us = NowUs() + 100000;
+    const int frames = options.seconds * 1000000 / options.period_us;
+
+    // The main loop sleeps until the codec task says there is something to send
+    std::mutex send_mutex;
+    std::condition_variable send_cv;
+    bool send_pending = false;
+    auto on_send = [&]() {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        send_pending = true;
+        send_cv.notify_one();
+    };
+
+    std::vector<std::thread> load;
+    for (int i = 0; i < options.load; i++) {
+        load.emplace_back([&]() {
+            PinThread(options.cores);
+            while (running) {
+            }
+        });
+    }
+
+    std::thread input([&]() {
+        PinThread(options.cores);
+        for (int i = 0; i < frames; i++) {
+            int64_t deadline = start_us + (int64_t)(i + 1) * options.period_us;
+            SleepUntil(deadline);
+            auto frame = std::make_unique<Frame>();
+            queues.PushEncode(std::move(frame), input_probe);
+            capture_jitter.Add(NowUs() - deadline);
+        }
+    });
+    std::thread network([&]() {
+        PinThread(options.cores);
+        for (int i = 0; i < frames; i++) {
+            int64_t arrival = start_us + (int64_t)i * options.period_us;
+            SleepUntil(arrival);
+            auto frame = std::make_unique<Frame>();
+            if (!queues.PushDecode(std::move(frame), network_probe)) {
+                dropped++;
+            }
+        }
+    });
+    std::thread codec([&]() {
+        PinThread(options.cores);
+        while (queues.CodecStep(options, codec_probe, on_send)) {
+        }
+    });
+    std::thread sender([&]() {
+        PinThread(options.cores);
+        while (running) {
+            {
+                std::unique_lock<std::mutex> lock(send_mutex);
+                send_cv.wait_for(lock, std::chrono::milliseconds(10), [&]() { return send_pending; });
+                send_pending = false;
+            }
+            while (auto frame = queues.PopSend(sender_probe)) {
+                sent++;
+            }
+        }
+    });
+    std::thread output([&]() {
+        PinThread(options.cores);
+        // When the frames written so far end playing, 0 until the first one
+        int64_t play_end = 0;
+        while (auto frame = queues.PopPlayback(output_probe)) {
+            int64_t now = NowUs();
+            if (play_end > 0) {
+                playback_jitter.Add(std::max<int64_t>(0, now - play_end));
+            }
+            play_end = std::max(play_end, now) + options.period_us;
+            // The write returns once the previous frame started playing and its buffer is free
+            SleepUntil(play_end - options.period_us);
+            played++;
+        }
+    });
+
+    input.join();
+    network.join();
+    SleepUntil(NowUs() + 4 * options.period_us);
+    running = false;
+    queues.Stop();
+    codec.join();
+    sender.join();
+    output.join();
+    for (auto& thread : load) {
+        thread.join();
+    }
+
+    BenchResult result;
+    result.lock_wait = Summarize({&input_probe.lock, &network_probe.lock, &codec_probe.lock, &sender_probe.lock,
+        &output_probe.lock});
+    result.queue_op = Summarize({&input_probe.op, &network_probe.op, &codec_probe.op, &sender_probe.op, &output_probe.op});
+    result.capture_jitter = Summarize({&capture_jitter});
+    result.playback_jitter = Summarize({&playback_jitter});
+    result.sent = sent;
+    result.played = played;
+    result.dropped = dropped;
+    return result;
+}
+
+static void PrintUsage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --period <us>   Frame period (default 10000)\n"
+        "  --encode <us>   Encode time per frame (default 2500)\n"
+        "  --decode <us>   Decode time per frame (default 1500)\n"
+        "  --seconds <s>   Run time per design (default 10)\n"
+        "  --cores <n>     Cores the threads are pinned to (default 2, as the ESP32-S3)\n"
+        "  --load <n>      Busy threads competing for those cores (default 1)\n",
+        name);
+}
+
+static void PrintResult(const char* name, const BenchResult& result) {
+    auto line = [name](const char* metric, const Summary& summary) {
+        printf("  %-6s %-16s %9zu %10.2f %8lld %8lld %8lld\n", name, metric, summary.count, summary.total_ms,
+            (long long)summary.p50, (long long)summary.p99, (long long)summary.max);
+    };
+    if (result.lock_wait.count > 0) {
+        line("lock wait", result.lock_wait);
+    }
+    line("queue op", result.queue_op);
+    line("capture jitter", result.capture_jitter);
+    line("playback jitter", result.playback_jitter);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+        int value = atoi(argv[++i]);
+        if (strcmp(argv[i - 1], "--period") == 0) {
+            options.period_us = value;
+        } else if (strcmp(argv[i - 1], "--encode") == 0) {
+            options.encode_us = value;
+        } else if (strcmp(argv[i - 1], "--decode") == 0) {
+            options.decode_us = value;
+        } else if (strcmp(argv[i - 1], "--seconds") == 0) {
+            options.seconds = value;
+        } else if (strcmp(argv[i - 1], "--cores") == 0) {
+            options.cores = value;
+        } else if (strcmp(argv[i - 1], "--load") == 0) {
+            options.load = value;
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.period_us <= 0 || options.seconds <= 0 || options.cores <= 0 || options.load < 0) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    printf("Period %d us, encode %d us, decode %d us, %d s per design, %d cores, %d load threads\n",
+        options.period_us, options.encode_us, options.decode_us, options.seconds, options.cores, options.load);
+    auto before = RunPipeline<MutexQueues>(options);
+    auto after = RunPipeline<RingQueues>(options);
+    printf("  design metric              count   total ms  p50 us   p99 us   max us\n");
+    PrintResult("mutex", before);
+    PrintResult("ring", after);
+    printf("Frames: mutex sent %u, played %u, dropped %u; ring sent %u, played %u, dropped %u\n",
+        before.sent, before.played, before.dropped, after.sent, after.played, after.dropped);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Compares AudioResampler (each quality tier) with the OpusResampler the service used before,
+ * on the sample rate pairs the device runs: CPU time per second of audio, the error on a
+ * 1 kHz tone, and the aliasing left from a tone above the output Nyquist frequency.
+ */
+
+#include "audio_resampler.h"
+
+#include <opus_resampler.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_FRAME_MS 60
+#define BENCH_SECONDS 20
+
+struct RatePair {
+    int input;
+    int output;
+};
+
+// Codec capture to 16 kHz, 16 kHz to the speaker, and the 24 kHz TTS to the speaker
+static const RatePair kPairs[] = {
+    {48000, 16000}, {44100, 16000}, {24000, 16000},
+    {16000, 48000}, {16000, 24000}, {24000, 48000}, {24000, 44100},
+};
+
+struct BenchResult {
+    double us_per_second = 0;
+    double cycles_per_second = 0;
+    double tone_error_db = 0;
+    double alias_db = 0;
+};
+
+static uint64_t ReadCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static std::vector<int16_t> MakeTone(int sample_rate, double frequency, int samples, double amplitude) {
+    std::vector<int16_t> pcm(samples);
+    for (int i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)std::lround(amplitude * std::sin(2 * M_PI * frequency * i / sample_rate));
+    }
+    return pcm;
+}
+
+// Power of what is left after a least squares fit of a sine at the frequency, over the signal power
+static double ResidualDb(const std::vector<int16_t>& pcm, size_t skip, int sample_rate, double frequency) {
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for (size_t i = skip; i < pcm.size(); i++) {
+        double s = std::sin(2 * M_PI * frequency * i / sample_rate);
+        double c = std::cos(2 * M_PI * frequency * i / sample_rate);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += pcm[i] * s;
+        yc += pcm[i] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    double residual = 0, power = 0;
+    for (size_t i = skip; i < pcm.size(); i++) {
+        double fit = a * std::sin(2 * M_PI * frequency * i / sample_rate) + b * std::cos(2 * M_PI * frequency * i / sample_rate);
+        residual += (pcm[i] - fit) * (pcm[i] - fit);
+        power += fit * fit;
+    }
+    return 10 * std::log10(std::max(residual, 1e-9) / std::max(power, 1e-9));
+}
+
+static double RmsDbfs(const std::vector<int16_t>& pcm, size_t skip) {
+    double sum = 0;
+    for (size_t i = skip; i < pcm.size(); i++) {
+        sum += (double)pcm[i] * pcm[i];
+    }
+    double rms = std::sqrt(sum / std::max<size_t>(1, pcm.size() - skip));
+    return 20 * std::log10(std::max(rms, 1e-3) / 32768.0);
+}
+
+// Runs the input through in frames, as the service does
+template <typename Resampler>
+static std::vector<int16_t> Run(Resampler& resampler, const std::vector<int16_t>& input, int frame_samples) {
+    std::vector<int16_t> output;
+    std::vector<int16_t> frame_output;
+    for (size_t offset = 0; offset + frame_samples <= input.size(); offset += frame_samples) {
+        frame_output.resize(resampler.GetOutputSamples(frame_samples));
+        resampler.Process(input.data() + offset, frame_samples, frame_output.data());
+        output.insert(output.end(), frame_output.begin(), frame_output.end());
+    }
+    return output;
+}
+
+template <typename Resampler, typename Configure>
+static BenchResult Bench(const RatePair& pair, Configure configure) {
+    BenchResult result;
+    const int frame_samples = pair.input * BENCH_FRAME_MS / 1000;
+
+    // Speed, on speech-like noise so nothing is special-cased by the data
+    std::vector<int16_t> noise(pair.input * BENCH_SECONDS);
+    uint32_t seed = 1;
+    for (auto& sample : noise) {
+        seed = seed * 1664525 + 1013904223;
+        sample = (int16_t)((int32_t)(seed >> 16) - 32768) / 4;
+    }
+    {
+        Resampler resampler;
+        configure(resampler);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_cycles = ReadCycles();
+        auto output = Run(resampler, noise, frame_samples);
+        uint64_t cycles = ReadCycles() - start_cycles;
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        result.us_per_second = elapsed / BENCH_SECONDS;
+        result.cycles_per_second = (double)cycles / BENCH_SECONDS;
+        if (output.empty()) {
+            fprintf(stderr, "No output\n");
+        }
+    }
+
+    // Pass band: a 1 kHz tone should come out as a clean 1 kHz tone, the filter delay is skipped
+    {
+        Resampler resampler;
+        configure(resampler);
+        auto tone = MakeTone(pair.input, 1000, pair.input, 16000);
+        auto output = Run(resampler, tone, frame_samples);
+        result.tone_error_db = ResidualDb(output, pair.output / 100, pair.output, 1000);
+    }
+
+    // Stop band: a tone between the two Nyquist frequencies must not fold back into the output
+    if (pair.input > pair.output) {
+        Resampler resampler;
+        configure(resampler);
+        double frequency = pair.output / 2 + 0.37 * (pair.input - pair.output) / 2;
+        auto tone = MakeTone(pair.input, frequency, pair.input, 16000);
+        auto output = Run(resampler, tone, frame_samples);
+        result.alias_db = RmsDbfs(output, pair.output / 100) - 20 * std::log10(16000 / std::sqrt(2.0) / 32768.0);
+    }
+    return result;
+}
+
+static void Print(const char* name, const BenchResult& result, bool downsampling) {
+    printf("  %-10s %10.1f %12.0f %10.1f", name, result.us_per_second, result.cycles_per_second, result.tone_error_db);
+    if (downsampling) {
+        printf(" %10.1f", result.alias_db);
+    }
+    printf("\n");
+}
+
+int main() {
+    static const char* const kTierNames[] = {"low", "medium", "high"};
+
+    for (const auto& pair : kPairs) {
+        bool downsampling = pair.input > pair.output;
+        printf("%d -> %d Hz\n", pair.input, pair.output);
+        printf("  %-10s %10s %12s %10s%s\n", "resampler", "us/s", "cycles/s", "tone dB", downsampling ? "   alias dB" : "");
+
+        auto opus = Bench<OpusResampler>(pair, [&pair](OpusResampler& resampler) {
+            resampler.Configure(pair.input, pair.output);
+        });
+        Print("opus", opus, downsampling);
+
+        for (int tier = kAudioResamplerQualityLow; tier <= kAudioResamplerQualityHigh; tier++) {
+            auto result = Bench<AudioResampler>(pair, [&pair, tier](AudioResampler& resampler) {
+                resampler.Configure(pair.input, pair.output, (AudioResamplerQuality)tier);
+            });
+            Print(kTierNames[tier], result, downsampling);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef HOST_SHIM_BOARD_H
+#define HOST_SHIM_BOARD_H
+
+// The audio code only includes board.h, the harness hands the codec to AudioService directly
+
+#endif // HOST_SHIM_BOARD_H
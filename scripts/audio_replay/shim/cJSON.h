@@ -0,0 +1,6 @@
+#ifndef HOST_SHIM_CJSON_H
+#define HOST_SHIM_CJSON_H
+
+#include <cjson/cJSON.h>
+
+#endif // HOST_SHIM_CJSON_H
@@ -0,0 +1,6 @@
+#ifndef HOST_SHIM_DRIVER_I2S_STD_H
+#define HOST_SHIM_DRIVER_I2S_STD_H
+
+#include "i2s_common.h"
+
+#endif // HOST_SHIM_DRIVER_I2S_STD_H
@@ -0,0 +1,7 @@
+#ifndef HOST_SHIM_ESP_ATTR_H
+#define HOST_SHIM_ESP_ATTR_H
+
+// Everything runs from memory on the host
+#define IRAM_ATTR
+
+#endif // HOST_SHIM_ESP_ATTR_H
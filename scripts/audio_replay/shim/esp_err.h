@@ -0,0 +1,20 @@
+#ifndef HOST_SHIM_ESP_ERR_H
+#define HOST_SHIM_ESP_ERR_H
+
+#include <cstdio>
+#include <cstdlib>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERROR_CHECK(x) do {                                     \
+        esp_err_t err_rc_ = (x);                                    \
+        if (err_rc_ != ESP_OK) {                                    \
+            fprintf(stderr, "%s failed: %d\n", #x, err_rc_);        \
+            abort();                                                \
+        }                                                           \
+    } while (0)
+
+#endif // HOST_SHIM_ESP_ERR_H
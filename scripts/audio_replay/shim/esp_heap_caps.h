@@ -0,0 +1,15 @@
+#ifndef HOST_SHIM_ESP_HEAP_CAPS_H
+#define HOST_SHIM_ESP_HEAP_CAPS_H
+
+#include <cstdlib>
+#include <cstdint>
+
+#define MALLOC_CAP_DEFAULT (1 << 0)
+#define MALLOC_CAP_INTERNAL (1 << 1)
+#define MALLOC_CAP_SPIRAM (1 << 2)
+#define MALLOC_CAP_8BIT (1 << 3)
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif // HOST_SHIM_ESP_HEAP_CAPS_H
@@ -0,0 +1,24 @@
+#ifndef HOST_SHIM_ESP_LOG_H
+#define HOST_SHIM_ESP_LOG_H
+
+#include <cstdio>
+
+/*
+ * Logs go to stderr, so the harness report on stdout stays clean.
+ * HOST_LOG_LEVEL picks the most verbose level printed: 1 error, 2 warning, 3 info (default), 4 debug.
+ */
+int HostLogLevel();
+
+#define HOST_LOG(level, letter, tag, format, ...) do {                              \
+        if (HostLogLevel() >= level) {                                              \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__);       \
+        }                                                                           \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(5, "V", tag, format, ##__VA_ARGS__)
+
+#endif // HOST_SHIM_ESP_LOG_H
@@ -0,0 +1,7 @@
+#ifndef HOST_SHIM_ESP_MEMORY_UTILS_H
+#define HOST_SHIM_ESP_MEMORY_UTILS_H
+
+// There is no flash mapped data on the host, every sound counts as movable
+inline bool esp_ptr_in_drom(const void* ptr) { return false; }
+
+#endif // HOST_SHIM_ESP_MEMORY_UTILS_H
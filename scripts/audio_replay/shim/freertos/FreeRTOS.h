@@ -0,0 +1,35 @@
+#ifndef HOST_SHIM_FREERTOS_H
+#define HOST_SHIM_FREERTOS_H
+
+/*
+ * The subset of the FreeRTOS API used by the audio service, on top of std::thread.
+ * Priorities and core affinity are accepted and ignored.
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
+
+// There are no interrupts on the host, a critical section only has to exclude the other threads
+typedef std::mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux) (mux)->unlock()
+#define portENTER_CRITICAL_ISR(mux) (mux)->lock()
+#define portEXIT_CRITICAL_ISR(mux) (mux)->unlock()
+
+#endif // HOST_SHIM_FREERTOS_H
@@ -0,0 +1,19 @@
+#ifndef HOST_SHIM_FREERTOS_TASK_H
+#define HOST_SHIM_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+typedef struct HostTask* TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core_id);
+// Only vTaskDelete(NULL) at the end of a task function is supported, the thread exits when it returns
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+void vTaskPrioritySet(TaskHandle_t handle, UBaseType_t priority);
+TickType_t xTaskGetTickCount();
+
+#endif // HOST_SHIM_FREERTOS_TASK_H
@@ -0,0 +1,219 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <model_path.h>
+#include <esp_wn_models.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+
+/*
+ * Tasks, event groups and timers for the host build, on std::thread and condition variables.
+ */
+
+static const auto kStartTime = std::chrono::steady_clock::now();
+
+int HostLogLevel() {
+    static int level = [] {
+        const char* value = getenv("HOST_LOG_LEVEL");
+        return value != nullptr ? atoi(value) : 3;
+    }();
+    return level;
+}
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStartTime).count();
+}
+
+/* Tasks */
+
+struct HostTask {
+    const char* name;
+};
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core_id) {
+    // The handle is only used to change the priority, which the host ignores; it lives as long as the process
+    auto task = new HostTask{name};
+    std::thread([function, arg]() { function(arg); }).detach();
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void vTaskPrioritySet(TaskHandle_t handle, UBaseType_t priority) {
+}
+
+TickType_t xTaskGetTickCount() {
+    return esp_timer_get_time() / 1000;
+}
+
+/* Event groups */
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto satisfied = [group, bits, wait_for_all]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    if (ticks == portMAX_DELAY) {
+        group->cv.wait(lock, satisfied);
+    } else {
+        group->cv.wait_for(lock, std::chrono::milliseconds(ticks), satisfied);
+    }
+    EventBits_t result = group->bits;
+    if (clear_on_exit && satisfied()) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+/* Timers, each one has a thread that sleeps until the next expiry */
+
+struct HostTimer {
+    esp_timer_create_args_t args;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool running = false;
+    bool periodic = false;
+    bool deleted = false;
+    uint64_t period_us = 0;
+    std::chrono::steady_clock::time_point next;
+    uint32_t generation = 0;
+};
+
+static void TimerThread(HostTimer* timer) {
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    while (!timer->deleted) {
+        if (!timer->running) {
+            timer->cv.wait(lock);
+            continue;
+        }
+        uint32_t generation = timer->generation;
+        if (timer->cv.wait_until(lock, timer->next) != std::cv_status::timeout || generation != timer->generation ||
+            !timer->running) {
+            continue;
+        }
+        if (timer->periodic) {
+            timer->next += std::chrono::microseconds(timer->period_us);
+        } else {
+            timer->running = false;
+        }
+        // The callback may start or stop this timer, so it runs unlocked
+        lock.unlock();
+        timer->args.callback(timer->args.arg);
+        lock.lock();
+    }
+    lock.unlock();
+    delete timer;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    auto timer = new HostTimer();
+    timer->args = *args;
+    std::thread(TimerThread, timer).detach();
+    *handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t StartTimer(esp_timer_handle_t timer, uint64_t us, bool periodic) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->running = true;
+    timer->periodic = periodic;
+    timer->period_us = us;
+    timer->next = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    timer->generation++;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return StartTimer(timer, period_us, true);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return StartTimer(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->running = false;
+    timer->generation++;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->deleted = true;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+/* esp-sr, no models on the host */
+
+srmodel_list_t* esp_srmodel_init(const char* partition_label) {
+    return nullptr;
+}
+
+void esp_srmodel_deinit(srmodel_list_t* models) {
+}
+
+char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2) {
+    return nullptr;
+}
+
+const esp_wn_iface_t* esp_wn_handle_from_name(const char* model_name) {
+    return nullptr;
+}
@@ -0,0 +1,19 @@
+#ifndef HOST_SHIM_MODEL_PATH_H
+#define HOST_SHIM_MODEL_PATH_H
+
+// No esp-sr models on the host, the filters find nothing and the wake word stays off
+
+#define ESP_WN_PREFIX "wn"
+#define ESP_MN_PREFIX "mn"
+
+typedef struct {
+    char** model_name;
+    char** model_info;
+    int num;
+} srmodel_list_t;
+
+srmodel_list_t* esp_srmodel_init(const char* partition_label);
+void esp_srmodel_deinit(srmodel_list_t* models);
+char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2);
+
+#endif // HOST_SHIM_MODEL_PATH_H
@@ -0,0 +1,33 @@
+#ifndef HOST_SHIM_OPUS_DECODER_H
+#define HOST_SHIM_OPUS_DECODER_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+struct OpusDecoder;
+
+/*
+ * Host stand-in for the esp-opus-encoder wrapper, with the same interface, on top of libopus.
+ * An empty packet runs packet loss concealment for one frame.
+ */
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusDecoderWrapper();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm);
+    void ResetState();
+
+private:
+    std::mutex mutex_;
+    OpusDecoder* audio_dec_ = nullptr;
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_ = 0;
+};
+
+#endif // HOST_SHIM_OPUS_DECODER_H
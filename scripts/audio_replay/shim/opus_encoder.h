@@ -0,0 +1,35 @@
+#ifndef HOST_SHIM_OPUS_ENCODER_H
+#define HOST_SHIM_OPUS_ENCODER_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+struct OpusEncoder;
+
+/*
+ * Host stand-in for the esp-opus-encoder wrapper, with the same interface, on top of libopus.
+ */
+class OpusEncoderWrapper {
+public:
+    OpusEncoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusEncoderWrapper();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    void SetDtx(bool enable);
+    void SetComplexity(int complexity);
+    // pcm must hold exactly one frame
+    bool Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus);
+    void ResetState();
+
+private:
+    std::mutex mutex_;
+    OpusEncoder* audio_enc_ = nullptr;
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_ = 0;
+};
+
+#endif // HOST_SHIM_OPUS_ENCODER_H
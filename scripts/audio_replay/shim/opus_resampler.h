@@ -0,0 +1,27 @@
+#ifndef HOST_SHIM_OPUS_RESAMPLER_H
+#define HOST_SHIM_OPUS_RESAMPLER_H
+
+#include <cstdint>
+
+/*
+ * Host stand-in for the esp-opus-encoder resampler. It interpolates linearly, which is
+ * enough to benchmark the pipeline but is not the device's filter quality.
+ */
+class OpusResampler {
+public:
+    OpusResampler() = default;
+    ~OpusResampler() = default;
+
+    void Configure(int input_sample_rate, int output_sample_rate);
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+    int GetOutputSamples(int input_samples) const;
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+};
+
+#endif // HOST_SHIM_OPUS_RESAMPLER_H
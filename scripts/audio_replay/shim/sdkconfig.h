@@ -0,0 +1,9 @@
+#ifndef HOST_SHIM_SDKCONFIG_H
+#define HOST_SHIM_SDKCONFIG_H
+
+/*
+ * The harness builds the generic configuration: no AFE audio processor, no wake word
+ * model, no PSRAM. Options can be turned on from CMake with -DCONFIG_...=1.
+ */
+
+#endif // HOST_SHIM_SDKCONFIG_H
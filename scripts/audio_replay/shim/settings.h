@@ -0,0 +1,20 @@
+#ifndef HOST_SHIM_SETTINGS_H
+#define HOST_SHIM_SETTINGS_H
+
+#include <string>
+#include <cstdint>
+
+// No NVS on the host: reads return the default, writes are dropped
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) {}
+
+    std::string GetString(const std::string& key, const std::string& default_value = "") { return default_value; }
+    void SetString(const std::string& key, const std::string& value) {}
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) { return default_value; }
+    void SetInt(const std::string& key, int32_t value) {}
+    bool GetBool(const std::string& key, bool default_value = false) { return default_value; }
+    void SetBool(const std::string& key, bool value) {}
+};
+
+#endif // HOST_SHIM_SETTINGS_H
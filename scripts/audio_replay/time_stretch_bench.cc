@@ -0,0 +1,100 @@
+/*
+ * Measures AudioTimeStretcher at the catch-up speeds: the CPU time and cycles per 60 ms
+ * frame, the speed actually reached, and the pitch of a voiced tone before and after,
+ * which time-scale modification must leave alone.
+ */
+
+#include "audio_time_stretch.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_FRAME_MS 60
+#define BENCH_SECONDS 20
+#define BENCH_PITCH_HZ 180.0
+
+static const int kSampleRates[] = {16000, 24000, 48000};
+static const int kSpeeds[] = {1000, 1050, 1100, 1150};
+
+static uint64_t ReadCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// A voiced sound: harmonics of the pitch with a falling spectrum, a slow vibrato and some noise
+static std::vector<int16_t> MakeVoice(int sample_rate, int samples) {
+    std::vector<int16_t> pcm(samples);
+    double phase = 0;
+    uint32_t seed = 1;
+    for (int i = 0; i < samples; i++) {
+        double t = (double)i / sample_rate;
+        phase += 2 * M_PI * BENCH_PITCH_HZ * (1 + 0.01 * std::sin(2 * M_PI * 5 * t)) / sample_rate;
+        double value = 0;
+        for (int h = 1; h <= 10 && h * BENCH_PITCH_HZ < sample_rate / 2; h++) {
+            value += std::sin(h * phase) / h;
+        }
+        seed = seed * 1664525 + 1013904223;
+        value += ((int32_t)(seed >> 16) - 32768) / 32768.0 * 0.05;
+        pcm[i] = (int16_t)std::lround(value * 8000);
+    }
+    return pcm;
+}
+
+// Fundamental from the first autocorrelation peak within the voice range
+static double PitchHz(const std::vector<int16_t>& pcm, int sample_rate) {
+    size_t start = pcm.size() / 4;
+    size_t length = std::min<size_t>(pcm.size() / 2, sample_rate / 2);
+    int min_lag = sample_rate / 400;
+    int max_lag = sample_rate / 80;
+    double best = -1;
+    int best_lag = min_lag;
+    for (int lag = min_lag; lag <= max_lag; lag++) {
+        double sum = 0;
+        for (size_t i = start; i < start + length; i++) {
+            sum += (double)pcm[i] * pcm[i + lag];
+        }
+        if (sum > best) {
+            best = sum;
+            best_lag = lag;
+        }
+    }
+    return (double)sample_rate / best_lag;
+}
+
+int main() {
+    printf("%8s %8s %12s %14s %10s %10s\n", "rate", "speed", "us/frame", "cycles/frame", "reached", "pitch Hz");
+    for (int sample_rate : kSampleRates) {
+        const int frame_samples = sample_rate * BENCH_FRAME_MS / 1000;
+        auto input = MakeVoice(sample_rate, sample_rate * BENCH_SECONDS);
+
+        for (int speed : kSpeeds) {
+            AudioTimeStretcher stretcher;
+            stretcher.Configure(sample_rate);
+            stretcher.SetSpeed(speed);
+            std::vector<int16_t> output;
+            output.reserve(input.size());
+
+            size_t frames = 0;
+            auto start = std::chrono::steady_clock::now();
+            uint64_t start_cycles = ReadCycles();
+            for (size_t offset = 0; offset + frame_samples <= input.size(); offset += frame_samples) {
+                stretcher.Process(input.data() + offset, frame_samples, output);
+                frames++;
+            }
+            uint64_t cycles = ReadCycles() - start_cycles;
+            auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+            printf("%8d %8.2f %12.2f %14.0f %10.3f %10.1f\n", sample_rate, speed / 1000.0, elapsed / frames,
+                (double)cycles / frames, (double)input.size() / output.size(), PitchHz(output, sample_rate));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "wav_file.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct WavChunkHeader {
+    char id[4];
+    uint32_t size;
+};
+
+struct WavFormat {
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+};
+
+bool WavFile::Read(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    char riff[12];
+    if (fread(riff, 1, sizeof(riff), file) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s is not a WAV file\n", path.c_str());
+        fclose(file);
+        return false;
+    }
+
+    bool has_format = false;
+    WavChunkHeader chunk;
+    while (fread(&chunk, sizeof(chunk), 1, file) == 1) {
+        if (memcmp(chunk.id, "fmt ", 4) == 0) {
+            WavFormat format;
+            if (chunk.size < sizeof(format) || fread(&format, sizeof(format), 1, file) != 1) {
+                break;
+            }
+            fseek(file, chunk.size - sizeof(format), SEEK_CUR);
+            if (format.format != 1 || format.bits_per_sample != 16 || format.channels < 1 || format.channels > 2) {
+                fprintf(stderr, "%s: only 16-bit PCM with 1 or 2 channels is supported\n", path.c_str());
+                fclose(file);
+                return false;
+            }
+            sample_rate = format.sample_rate;
+            channels = format.channels;
+            has_format = true;
+        } else if (memcmp(chunk.id, "data", 4) == 0 && has_format) {
+            samples.resize(chunk.size / sizeof(int16_t));
+            size_t read = fread(samples.data(), sizeof(int16_t), samples.size(), file);
+            samples.resize(read - read % channels);
+            fclose(file);
+            return true;
+        } else {
+            fseek(file, chunk.size + (chunk.size & 1), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "%s has no PCM data\n", path.c_str());
+    fclose(file);
+    return false;
+}
+
+bool WavFile::Write(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot create %s\n", path.c_str());
+        return false;
+    }
+
+    uint32_t data_size = samples.size() * sizeof(int16_t);
+    WavFormat format = {
+        .format = 1,
+        .channels = (uint16_t)channels,
+        .sample_rate = (uint32_t)sample_rate,
+        .byte_rate = (uint32_t)(sample_rate * channels * sizeof(int16_t)),
+        .block_align = (uint16_t)(channels * sizeof(int16_t)),
+        .bits_per_sample = 16,
+    };
+    uint32_t riff_size = 4 + sizeof(WavChunkHeader) + sizeof(format) + sizeof(WavChunkHeader) + data_size;
+    WavChunkHeader format_header = {{'f', 'm', 't', ' '}, sizeof(format)};
+    WavChunkHeader data_header = {{'d', 'a', 't', 'a'}, data_size};
+
+    bool ok = fwrite("RIFF", 1, 4, file) == 4 &&
+        fwrite(&riff_size, sizeof(riff_size), 1, file) == 1 &&
+        fwrite("WAVE", 1, 4, file) == 4 &&
+        fwrite(&format_header, sizeof(format_header), 1, file) == 1 &&
+        fwrite(&format, sizeof(format), 1, file) == 1 &&
+        fwrite(&data_header, sizeof(data_header), 1, file) == 1 &&
+        fwrite(samples.data(), sizeof(int16_t), samples.size(), file) == samples.size();
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s\n", path.c_str());
+    }
+    return ok;
+}
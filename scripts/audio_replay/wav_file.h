@@ -0,0 +1,18 @@
+#ifndef WAV_FILE_H
+#define WAV_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 16-bit PCM WAV, interleaved samples
+struct WavFile {
+    int sample_rate = 16000;
+    int channels = 1;
+    std::vector<int16_t> samples;
+
+    bool Read(const std::string& path);
+    bool Write(const std::string& path) const;
+};
+
+#endif // WAV_FILE_H